@@ -0,0 +1,67 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "raytracer.h"
+#include "ray.h"
+
+#include <algorithm>
+
+
+// Axis-aligned bounding box. A default constructed box is empty (min > max) so that
+// growing it by any point or box yields exactly that point or box.
+class aabb {
+public:
+    vec3 min = vec3( INFINITY,  INFINITY,  INFINITY);
+    vec3 max = vec3(-INFINITY, -INFINITY, -INFINITY);
+
+    aabb() {}
+
+    aabb(const vec3& a, const vec3& b) : min(glm::min(a, b)), max(glm::max(a, b)) {}
+
+    aabb(const aabb& a, const aabb& b) : min(glm::min(a.min, b.min)), max(glm::max(a.max, b.max)) {}
+
+    void expand(const vec3& p) {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    void expand(const aabb& b) {
+        min = glm::min(min, b.min);
+        max = glm::max(max, b.max);
+    }
+
+    bool empty() const { return min.x > max.x || min.y > max.y || min.z > max.z; }
+
+    vec3 centroid() const { return real(0.5) * (min + max); }
+
+    real surface_area() const {
+        if (empty())
+            return 0;
+        vec3 d = max - min;
+        return 2 * (d.x*d.y + d.y*d.z + d.z*d.x);
+    }
+
+    int longest_axis() const {
+        vec3 d = max - min;
+        if (d.x > d.y)
+            return d.x > d.z ? 0 : 2;
+        return d.y > d.z ? 1 : 2;
+    }
+
+    // Slab test against a ray given by its origin and per-axis inverse direction. Returns the
+    // entry distance, or INFINITY if the ray misses the box within [tmin, tmax].
+    real hit(const vec3& origin, const vec3& inv_dir, real tmin, real tmax) const {
+        for (int axis = 0; axis < 3; axis++) {
+            real t0 = (min[axis] - origin[axis]) * inv_dir[axis];
+            real t1 = (max[axis] - origin[axis]) * inv_dir[axis];
+            if (inv_dir[axis] < 0)
+                std::swap(t0, t1);
+            // Written so that NaNs (0 * inf on a slab boundary) leave the interval untouched.
+            tmin = t0 > tmin ? t0 : tmin;
+            tmax = t1 < tmax ? t1 : tmax;
+        }
+        return tmin <= tmax ? tmin : INFINITY;
+    }
+};
+
+#endif //AABB_H
@@ -0,0 +1,145 @@
+#ifndef ASYNC_RENDERER_H
+#define ASYNC_RENDERER_H
+
+#include "raytracer.h"
+#include "camera.h"
+#include "hittable.h"
+#include "thread_pool.h"
+#include "triple_buffer.h"
+
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Renders frames on a background thread so that an interactive loop never waits for a trace.
+// The loop hands over the latest view with set_view() and, once per displayed frame, picks up the
+// newest finished image with acquire(); finished frames go through a triple_buffer, so neither
+// side blocks the other. A progressive view that has converged leaves the render thread idle
+// until the view changes. Frames are traced into the renderer's own memory, or straight into
+// three caller-provided targets (e.g. mapped pixel buffers, see texture_stream), one per slot.
+//
+//     async_renderer renderer(scene, cam);
+//     while (running) {
+//         handle_input(cam);
+//         renderer.set_view(cam);
+//         if (renderer.acquire())
+//             upload(renderer.latest().pixels);
+//         present();
+//     }
+class async_renderer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    struct frame {
+        const unsigned char* pixels = nullptr;            // RGB, bottom row first, as camera::render
+        int width = 0, height = 0;
+        long long traced = 0;                             // Pixels traced; the rest were reprojected
+        int slot = 0;                                     // Which of the three frame buffers this is
+        bool in_target = false;                           // pixels lies in targets[slot], not in storage
+        long long number = 0;                             // Frames rendered before this one
+        clock::time_point trace_start, trace_end;
+        std::vector<thread_pool::worker_span> threads;    // Per-thread tile work of the trace
+        std::vector<unsigned char> storage;               // Backs pixels unless in_target
+    };
+
+    // targets, if given, are three buffers of target_size bytes each that frames fitting into
+    // them are traced into directly. A slot's target is written only while the render thread
+    // owns its frame, i.e. from the acquire() that hands the frame back until it is published.
+    async_renderer(const hittable& world, const camera_settings& view,
+                   const std::array<unsigned char*, 3>& targets = {}, size_t target_size = 0)
+        : world(world), targets(targets), target_size(target_size), pending(view) {
+        for (int i = 0; i < 3; i++) {
+            frames.buffer(i).slot = i;
+        }
+        producer = std::thread([this](){ run(); });
+    }
+
+    ~async_renderer() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        producer.join();
+    }
+
+    async_renderer(const async_renderer&) = delete;
+    async_renderer& operator=(const async_renderer&) = delete;
+
+    // Camera settings for the next frame to be started; the frame in flight keeps its own.
+    void set_view(const camera_settings& view) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (view == pending)
+                return;
+            pending = view;
+            view_changed = true;
+        }
+        wake.notify_one();
+    }
+
+    // Makes the newest finished frame available through latest(). Returns false if no frame
+    // finished since the last call.
+    bool acquire() { return frames.acquire(); }
+
+    // The frame last acquired; empty before the first one.
+    const frame& latest() const { return frames.front(); }
+
+private:
+    const hittable& world;
+    camera cam;                       // Used by the render thread only
+    triple_buffer<frame> frames;
+    std::array<unsigned char*, 3> targets;
+    size_t target_size;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    camera_settings pending;
+    bool view_changed = true;
+    bool stopping = false;
+    std::thread producer;
+
+    void run() {
+        long long number = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [&](){ return stopping || view_changed || !cam.converged(); });
+                if (stopping)
+                    return;
+                static_cast<camera_settings&>(cam) = pending;
+                view_changed = false;
+            }
+
+            frame& f = frames.back();
+            cam.update();
+            f.width = cam.width;
+            f.height = cam.rendered_height();
+            size_t size = size_t(f.width) * f.height * 3;
+            f.in_target = targets[f.slot] != nullptr && size <= target_size;
+            if (!f.in_target)
+                f.storage.resize(size);
+            unsigned char* pixels = f.in_target ? targets[f.slot] : f.storage.data();
+            f.pixels = pixels;
+            f.trace_start = clock::now();
+            if (!cam.render(pixels, world))
+                continue;   // Converged; nothing new to show
+            f.trace_end = clock::now();
+            f.traced = cam.traced_pixels();
+
+            const thread_pool& pool = *cam.render_threads();
+            f.threads.resize(pool.size());
+            for (int w = 0; w < pool.size(); w++) {
+                f.threads[w] = pool.last_span(w);
+            }
+            f.number = number++;
+            frames.publish();
+        }
+    }
+};
+
+#endif //ASYNC_RENDERER_H
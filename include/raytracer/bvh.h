@@ -0,0 +1,431 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "raytracer.h"
+#include "aabb.h"
+#include "hittable.h"
+#include "hittable_list.h"
+#include "primitive.h"
+
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <vector>
+
+
+// Bounding volume hierarchy over the objects of a hittable_list, built with a binned
+// surface area heuristic. Nodes live in one flat array; the two children of an interior node
+// are stored next to each other. Traversal visits the nearer child first and skips any box
+// that starts beyond the closest hit found so far, so a ray typically touches O(log N) objects.
+// Build it once from the scene and pass it anywhere a hittable_list is, e.g. to camera::render.
+//
+// Object is how leaves hold their objects: bvh keeps the shared_ptr<hittable>s of a hittable_list
+// and calls them virtually, static_bvh keeps the primitives of a primitive_list by value so that
+// primitive intersection is inlined into the traversal loop.
+template <typename Object>
+class basic_bvh : public hittable {
+public:
+    struct bvh_node {
+        aabb     bbox;
+        uint32_t first;  // Interior: index of left child (right child is first+1). Leaf: first object.
+        uint32_t count;  // Number of objects in a leaf, 0 for interior nodes.
+
+        bool is_leaf() const { return count > 0; }
+    };
+
+    static constexpr int   num_bins             = 16;    // SAH candidate split planes per axis
+    static constexpr int   max_leaf_size        = 4;     // Leaves never hold more objects than this
+    static constexpr float traversal_cost       = 1.0f;  // Cost of a box test relative to an object test
+    static constexpr int   traversal_stack_size = 64;    // Traversal stack entries; builds keep every
+                                                         // leaf within 63 levels of the root to fit it
+
+    basic_bvh() {}
+
+    basic_bvh(std::vector<Object> list) : objects(std::move(list)) { build(); }
+
+    basic_bvh(const hittable_list& list) requires std::same_as<Object, shared_ptr<hittable>>
+        : basic_bvh(list.objects) {}
+
+    basic_bvh(const primitive_list& list) requires std::same_as<Object, primitive>
+        : basic_bvh(list.objects) {}
+
+    // Adopts a tree built earlier (see node_array() and object_array()), e.g. one loaded from a
+    // scene cache, without building anything.
+    basic_bvh(std::vector<Object> list, std::vector<bvh_node> tree) : objects(std::move(list)), nodes(std::move(tree)) {}
+
+    bool intersect(const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) const override {
+        if (nodes.empty())
+            return false;
+
+        vec3 origin = r.origin();
+        vec3 inv_dir = real(1) / r.direction();
+        auto closest_so_far = ray_tmax;
+        bool hit_anything = false;
+
+        uint32_t stack[traversal_stack_size];
+        int stack_size = 0;
+        uint32_t index = 0;
+        if (nodes[0].bbox.hit(origin, inv_dir, ray_tmin, closest_so_far) == INFINITY)
+            return false;
+
+        while (true) {
+            const bvh_node& node = nodes[index];
+            if (node.is_leaf()) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    if (intersect_object(objects[i], r, ray_tmin, closest_so_far, hit)) {
+                        hit_anything = true;
+                        closest_so_far = hit.t;
+                    }
+                }
+            } else {
+                // Visit the nearer child first; defer the farther one if it is still reachable.
+                uint32_t near_child = node.first, far_child = node.first + 1;
+                real t_near = nodes[near_child].bbox.hit(origin, inv_dir, ray_tmin, closest_so_far);
+                real t_far  = nodes[far_child].bbox.hit(origin, inv_dir, ray_tmin, closest_so_far);
+                if (t_far < t_near) {
+                    std::swap(near_child, far_child);
+                    std::swap(t_near, t_far);
+                }
+                if (t_near != INFINITY) {
+                    if (t_far != INFINITY)
+                        stack[stack_size++] = far_child;
+                    index = near_child;
+                    continue;
+                }
+            }
+
+            // Pop the next deferred node that can still hold a closer hit.
+            do {
+                if (stack_size == 0)
+                    return hit_anything;
+                index = stack[--stack_size];
+            } while (nodes[index].bbox.hit(origin, inv_dir, ray_tmin, closest_so_far) == INFINITY);
+        }
+    }
+
+    // Traverses the tree once for the whole packet. A node is skipped when it lies outside the
+    // packet frustum or when no ray enters it before that ray's closest hit.
+    void intersect_packet(const ray_packet& packet, packet_hits& hits) const override {
+        if (nodes.empty())
+            return;
+
+        vec3 center_dir = packet.direction(ray_packet::size / 2 + ray_packet::width / 2);
+        uint32_t stack[traversal_stack_size];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            const bvh_node& node = nodes[stack[--stack_size]];
+            if (!packet.frustum_overlaps(node.bbox) || packet.hit_box(node.bbox, hits.t) == INFINITY)
+                continue;
+
+            if (node.is_leaf()) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    intersect_object_packet(objects[i], packet, hits);
+                }
+            } else {
+                // Push the farther child first so the nearer one is traversed next; "nearer" is
+                // judged along the direction of the packet's middle ray.
+                vec3 separation = nodes[node.first + 1].bbox.centroid() - nodes[node.first].bbox.centroid();
+                bool left_first = dot(separation, center_dir) >= 0.0f;
+                stack[stack_size++] = left_first ? node.first + 1 : node.first;
+                stack[stack_size++] = left_first ? node.first : node.first + 1;
+            }
+        }
+    }
+
+    // Any-hit traversal: the first object hit ends the search. Nearer children still go first,
+    // as the closest occluder is the likeliest to be found early, but the ray's extent never
+    // shrinks and a popped node needs no second box test.
+    bool occluded(const ray& r, real ray_tmin, real ray_tmax) const override {
+        if (nodes.empty())
+            return false;
+
+        vec3 origin = r.origin();
+        vec3 inv_dir = real(1) / r.direction();
+        uint32_t stack[traversal_stack_size];
+        int stack_size = 0;
+        uint32_t index = 0;
+        if (nodes[0].bbox.hit(origin, inv_dir, ray_tmin, ray_tmax) == INFINITY)
+            return false;
+
+        while (true) {
+            const bvh_node& node = nodes[index];
+            if (node.is_leaf()) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    if (occluded_object(objects[i], r, ray_tmin, ray_tmax))
+                        return true;
+                }
+            } else {
+                uint32_t near_child = node.first, far_child = node.first + 1;
+                real t_near = nodes[near_child].bbox.hit(origin, inv_dir, ray_tmin, ray_tmax);
+                real t_far  = nodes[far_child].bbox.hit(origin, inv_dir, ray_tmin, ray_tmax);
+                if (t_far < t_near) {
+                    std::swap(near_child, far_child);
+                    std::swap(t_near, t_far);
+                }
+                if (t_near != INFINITY) {
+                    if (t_far != INFINITY)
+                        stack[stack_size++] = far_child;
+                    index = near_child;
+                    continue;
+                }
+            }
+            if (stack_size == 0)
+                return false;
+            index = stack[--stack_size];
+        }
+    }
+
+    // Packet counterpart of occluded(). Occluded rays drop out of the box tests (see
+    // packet_occlusion), and traversal ends once every ray is occluded.
+    void occluded_packet(const ray_packet& packet, packet_occlusion& occlusion) const override {
+        if (nodes.empty())
+            return;
+
+        uint32_t stack[traversal_stack_size];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            const bvh_node& node = nodes[stack[--stack_size]];
+            if (!packet.frustum_overlaps(node.bbox) || packet.hit_box(node.bbox, occlusion.t) == INFINITY)
+                continue;
+
+            if (node.is_leaf()) {
+                for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                    occluded_object_packet(objects[i], packet, occlusion);
+                }
+                if (occlusion.all_occluded())
+                    return;
+            } else {
+                stack[stack_size++] = node.first + 1;
+                stack[stack_size++] = node.first;
+            }
+        }
+    }
+
+    aabb bounding_box() const override { return nodes.empty() ? aabb() : nodes[0].bbox; }
+
+    const std::vector<bvh_node>& node_array() const { return nodes; }
+    const std::vector<Object>& object_array() const { return objects; }
+
+    // Replaces the object in a slot of object_array(), e.g. one that moved. Node boxes are stale
+    // until the next refit() or rebuild.
+    void set_object(uint32_t slot, const Object& object) { objects[slot] = object; }
+
+    // Updates every box bottom-up from the current object bounds, keeping the tree's topology.
+    // Cheap, and enough for small motion; as objects travel further from where they were at
+    // build time, boxes grow and overlap and the tree gets slower (see sah_cost()).
+    void refit() {
+        // Children are always stored after their parent, so a reverse sweep visits them first.
+        for (size_t i = nodes.size(); i-- > 0;) {
+            bvh_node& node = nodes[i];
+            aabb bounds;
+            if (node.is_leaf()) {
+                for (uint32_t k = node.first; k < node.first + node.count; k++) {
+                    bounds.expand(object_bounds(objects[k]));
+                }
+            } else {
+                bounds = aabb(nodes[node.first].bbox, nodes[node.first + 1].bbox);
+            }
+            node.bbox = bounds;
+        }
+    }
+
+    // Builds the subtree under a node again from its current objects. The new nodes are
+    // appended; the old ones stay in the array, unreachable, until the next full rebuild().
+    // depth is the node's level below the root, which bounds how deep the new subtree may go.
+    void rebuild(uint32_t index, int depth) {
+        uint32_t last = index, first = index;
+        while (!nodes[first].is_leaf())
+            first = nodes[first].first;
+        while (!nodes[last].is_leaf())
+            last = nodes[last].first + 1;
+        uint32_t begin = nodes[first].first, end = nodes[last].first + nodes[last].count;
+
+        std::vector<build_ref> refs = make_refs(begin, end);
+        nodes[index] = bvh_node{aabb(), begin, end - begin};
+        subdivide(index, refs, begin, depth);
+        reorder(refs, begin);
+    }
+
+    // Builds the whole tree again, dropping nodes left over by partial rebuilds.
+    void rebuild() {
+        nodes.clear();
+        build();
+    }
+
+    // Expected cost of a ray through the tree by the surface area heuristic: the node and object
+    // tests each reachable node costs, weighted by the chance that a ray through the root box
+    // also passes through the node's box. Lower is better; a fresh build minimizes it greedily.
+    float sah_cost() const {
+        if (nodes.empty() || nodes[0].bbox.surface_area() <= 0)
+            return 0.0f;
+        float root_area = nodes[0].bbox.surface_area();
+        float cost = 0.0f;
+        uint32_t stack[traversal_stack_size];
+        int stack_size = 0;
+        stack[stack_size++] = 0;
+        while (stack_size > 0) {
+            const bvh_node& node = nodes[stack[--stack_size]];
+            float weight = node.bbox.surface_area() / root_area;
+            if (node.is_leaf()) {
+                cost += weight * float(node.count);
+            } else {
+                cost += weight * traversal_cost;
+                stack[stack_size++] = node.first;
+                stack[stack_size++] = node.first + 1;
+            }
+        }
+        return cost;
+    }
+
+private:
+    std::vector<Object> objects;  // Reordered so every leaf covers a contiguous run
+    std::vector<bvh_node> nodes;
+
+    // Per-object data used only while building.
+    struct build_ref {
+        aabb bbox;
+        vec3 centroid;
+        uint32_t object;
+    };
+
+    void build() {
+        if (objects.empty())
+            return;
+
+        std::vector<build_ref> refs = make_refs(0, uint32_t(objects.size()));
+        nodes.reserve(2 * objects.size());
+        nodes.push_back(bvh_node{aabb(), 0, uint32_t(refs.size())});
+        subdivide(0, refs, 0, 0);
+        reorder(refs, 0);
+    }
+
+    std::vector<build_ref> make_refs(uint32_t begin, uint32_t end) const {
+        std::vector<build_ref> refs(end - begin);
+        for (uint32_t i = begin; i < end; i++) {
+            build_ref& ref = refs[i - begin];
+            ref.bbox = object_bounds(objects[i]);
+            ref.centroid = ref.bbox.centroid();
+            ref.object = i;
+        }
+        return refs;
+    }
+
+    // Moves the objects of refs, which cover the slots from base on, into the order of refs.
+    void reorder(const std::vector<build_ref>& refs, uint32_t base) {
+        std::vector<Object> ordered;
+        ordered.reserve(refs.size());
+        for (const auto& ref : refs) {
+            ordered.push_back(objects[ref.object]);
+        }
+        std::move(ordered.begin(), ordered.end(), objects.begin() + base);
+    }
+
+    // Splits a node at the given depth below the root recursively. refs[i - base] describes
+    // object slot i. Leaves never lie deeper than the traversal stacks hold: at the last level
+    // a node stays a leaf, and where an SAH split would leave a side too many objects to reach
+    // leaf size by halving in the levels left, the node is halved instead.
+    void subdivide(uint32_t index, std::vector<build_ref>& refs, uint32_t base, int depth) {
+        uint32_t first = nodes[index].first, count = nodes[index].count;
+
+        aabb bounds, centroid_bounds;
+        for (uint32_t i = first; i < first + count; i++) {
+            bounds.expand(refs[i - base].bbox);
+            centroid_bounds.expand(refs[i - base].centroid);
+        }
+        nodes[index].bbox = bounds;
+        int levels_left = traversal_stack_size - 1 - depth;
+        if (count <= 1 || levels_left <= 0)
+            return;
+
+        // Find the cheapest binned SAH split over all three axes.
+        int best_axis = -1, best_bin = 0;
+        float best_cost = INFINITY;
+        for (int axis = 0; axis < 3; axis++) {
+            float lo = centroid_bounds.min[axis], hi = centroid_bounds.max[axis];
+            if (hi <= lo)
+                continue;
+
+            aabb bin_bounds[num_bins];
+            int bin_counts[num_bins] = {};
+            float scale = num_bins / (hi - lo);
+            for (uint32_t i = first; i < first + count; i++) {
+                int b = std::min(num_bins - 1, int((refs[i - base].centroid[axis] - lo) * scale));
+                bin_bounds[b].expand(refs[i - base].bbox);
+                bin_counts[b]++;
+            }
+
+            // Sweep from the right to get the area and count for every right-hand partition.
+            float right_area[num_bins - 1];
+            int right_count[num_bins - 1];
+            aabb right_box;
+            int right_sum = 0;
+            for (int b = num_bins - 1; b > 0; b--) {
+                right_box.expand(bin_bounds[b]);
+                right_sum += bin_counts[b];
+                right_area[b-1] = right_box.surface_area();
+                right_count[b-1] = right_sum;
+            }
+
+            aabb left_box;
+            int left_sum = 0;
+            for (int b = 0; b < num_bins - 1; b++) {
+                left_box.expand(bin_bounds[b]);
+                left_sum += bin_counts[b];
+                float cost = left_sum * left_box.surface_area() + right_count[b] * right_area[b];
+                if (left_sum > 0 && right_count[b] > 0 && cost < best_cost) {
+                    best_cost = cost;
+                    best_axis = axis;
+                    best_bin = b;
+                }
+            }
+        }
+
+        // Split only if it beats testing every object, unless the leaf would be too big.
+        uint32_t left_count;
+        if (best_axis < 0) {
+            // All centroids coincide, so any split is as good as another; halve the list.
+            if (count <= max_leaf_size)
+                return;
+            left_count = count / 2;
+        } else {
+            float leaf_cost = float(count);
+            float split_cost = traversal_cost + best_cost / bounds.surface_area();
+            if (count <= max_leaf_size && split_cost >= leaf_cost)
+                return;
+
+            float lo = centroid_bounds.min[best_axis];
+            float scale = num_bins / (centroid_bounds.max[best_axis] - lo);
+            auto middle = std::partition(refs.begin() + (first - base), refs.begin() + (first - base + count),
+                [&](const build_ref& ref) {
+                    return std::min(num_bins - 1, int((ref.centroid[best_axis] - lo) * scale)) <= best_bin;
+                });
+            left_count = uint32_t(middle - refs.begin()) - (first - base);
+
+            // Objects a child can take and still end in leaves of max_leaf_size by halving.
+            uint64_t capacity = levels_left > 32 ? UINT64_MAX : uint64_t(max_leaf_size) << (levels_left - 1);
+            if (std::max(left_count, count - left_count) > capacity) {
+                std::nth_element(refs.begin() + (first - base), refs.begin() + (first - base + count / 2),
+                    refs.begin() + (first - base + count), [&](const build_ref& a, const build_ref& b) {
+                        return a.centroid[best_axis] < b.centroid[best_axis];
+                    });
+                left_count = count / 2;
+            }
+        }
+
+        uint32_t left = uint32_t(nodes.size());
+        nodes.push_back(bvh_node{aabb(), first, left_count});
+        nodes.push_back(bvh_node{aabb(), first + left_count, count - left_count});
+        nodes[index].first = left;
+        nodes[index].count = 0;
+
+        subdivide(left, refs, base, depth + 1);
+        subdivide(left + 1, refs, base, depth + 1);
+    }
+};
+
+using bvh = basic_bvh<shared_ptr<hittable>>;
+using static_bvh = basic_bvh<primitive>;
+
+#endif //BVH_H
@@ -3,20 +3,49 @@
 
 #include "hittable.h"
 #include "color.h"
+#include "material.h"
+#include "primitive.h"
 #include "raytracer.h"
+#include "reprojection_cache.h"
+#include "sampler.h"
+#include "screen_bins.h"
+#include "thread_pool.h"
+#include "tiled_framebuffer.h"
 
-#include <thread>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
 
 
-class camera {
-public:
-
+// Everything about a camera that its owner sets: view, image size and render options. Kept apart
+// from the camera's per-frame state so a view can be handed to another thread by value.
+struct camera_settings {
     float aspect_ratio  = 1.0;                  // Ratio of image width over height
     int    width        = 100;                  // Rendered image width in pixel count
+    int    image_height = 0;                    // Rendered image height, 0 derives it from aspect_ratio
+    int    samples_per_pixel = 1;               // Jittered samples averaged per pixel
     double vfov         = 90.0;                 // Vertical view angle (field of view)
     vec3 lookfrom       = vec3(0,0,0);   // Point camera is looking from
     vec3 lookat         = vec3(0,0,-1);  // Point camera is looking at
     vec3   vup          = vec3(0,1,0);     // Camera-relative "up" direction
+    int    tile_size    = 16;                   // Edge length of the square tiles handed to render threads
+    int    num_threads  = default_thread_count();   // Render threads, defaults to hardware concurrency
+    bool   pin_threads  = false;                // Pin render threads to cores, one per physical core first
+    bool   tile_binning = true;                 // Bin a primitive_list world to tiles for primary rays
+#ifdef RAYTRACER_DOUBLE_PRECISION
+    bool   packet_tracing = false;              // Packets trace in float; keep reference renders in double
+#else
+    bool   packet_tracing = true;               // Trace primary rays as 8x8 ray_packets
+#endif
+    bool   progressive  = false;                // Accumulate samples over frames while the view is unchanged
+    int    max_accumulated_samples = 4096;      // Per-pixel sample count at which a still view stops tracing
+    bool   temporal_reprojection = false;       // Reuse the previous frame's pixels where they reproject
+    float  reprojection_refresh = 0.125f;       // Share of the screen retraced per frame regardless
+    bool   path_tracing = false;                // Light by materials and bounces; otherwise shade by normal
+    int    max_depth    = 8;                    // Bounces per path at most
+    int    roulette_depth = 3;                  // Bounces after which paths may end by Russian roulette
+    sampler::sequence sampling = sampler::sequence::sobol;   // Random numbers of the path bounces
 
     float pitch = 0.0f;
     float yaw = -90.0f;
@@ -26,79 +55,280 @@ public:
     vec3   up       = vec3(0, 1, 0);
     vec3   forward  = vec3(0, 0, -1);              // Camera frame basis vectors
 
+    bool operator==(const camera_settings&) const = default;
+};
 
-    void render(unsigned char* pixels, const hittable& world) {
-        initialize();
-        int num_threads = 4;
-        std::vector <int> partitions;
-        partitions.push_back(0);
-        std::vector <std::thread> threads;
-
-        for (int j = 0; j < num_threads; j++) {
-            partitions.push_back(int((j+1)/num_threads * height));
-            threads.push_back(std::thread([this, pixels, &partitions, &world, j](){
-            render_loop(pixels, partitions.at(j), partitions.at(j+1), world);}));
+
+class camera : public camera_settings {
+public:
+
+    // Recomputes the camera frame and viewport from the settings above. render() does this every
+    // frame; call it directly before using get_ray() on its own.
+    void update() { initialize(); }
+
+    // Image height in pixels, as derived by the last update() or render().
+    int rendered_height() const { return height; }
+
+    // True once a progressive view has all its samples, so rendering it again traces nothing.
+    bool converged() const { return progressive && accumulated >= max_accumulated_samples; }
+
+    // Render threads of the last frame (for their per-thread timing), or null before the first frame.
+    const thread_pool* render_threads() const { return pool.get(); }
+
+    // Primary ray through pixel (i, j) for sample s.
+    ray get_ray(int i, int j, int s = 0) const {
+        return ray(lookfrom, pixel_direction(i, j, sample_offset(s)));
+    }
+
+    // Samples per pixel averaged into the last progressive frame.
+    int accumulated_samples() const { return accumulated; }
+
+    // Pixels actually traced by the last frame; the rest came from reprojection.
+    long long traced_pixels() const { return last_traced; }
+
+    // Drops everything kept from earlier frames (accumulated samples, the reprojection cache),
+    // e.g. after the scene changed. Camera moves and setting changes are detected by render().
+    void reset_history() {
+        accumulated = 0;
+        history.invalidate();
+    }
+
+
+    // Traces one frame into pixels. In progressive mode the frame's samples are added to those of
+    // earlier frames with the same view, and pixels receives the running average; once
+    // max_accumulated_samples is reached, pixels is left as it is, nothing is traced and render()
+    // returns false.
+    // With temporal_reprojection, a frame from a new view first reprojects the previous frame and
+    // traces only the blocks that nothing reprojected onto, plus a rotating refresh share.
+    bool render(unsigned char* pixels, const hittable& world) {
+        return render_frame(pixels, world, nullptr);
+    }
+
+    // A flat primitive_list has no acceleration structure. With tile_binning it is first binned to
+    // the tiles (see screen_bins), so each tile's primary rays test only the primitives whose
+    // screen bounds overlap it; bounces still see the whole list.
+    bool render(unsigned char* pixels, const primitive_list& world) {
+        return render_frame(pixels, world, tile_binning ? &world : nullptr);
+    }
+
+
+    // Renders the pixels [x0, x1) x [y0, y1) into the framebuffer and returns how many of them
+    // were traced. Pixels, or packet blocks, are visited in Morton order, so consecutive rays
+    // stay close on screen in both directions and keep meeting the same scene data. Primary rays
+    // go to primary, which may leave out whatever these pixels can't see (e.g. a tile's bin);
+    // bounces go to world.
+    int render_loop (int x0, int y0, int x1, int y1, const hittable& world, const hittable& primary) {
+        int traced = 0;
+        if (packet_tracing) {
+            int blocks_x = (x1 - x0 + ray_packet::width - 1) / ray_packet::width;
+            int blocks_y = (y1 - y0 + ray_packet::width - 1) / ray_packet::width;
+            tiled_framebuffer::for_each_morton(blocks_x, blocks_y, [&](int u, int v) {
+                int bx = x0 + u*ray_packet::width, by = y0 + v*ray_packet::width;
+                traced += render_packet(bx, by, std::min(bx + ray_packet::width, x1),
+                    std::min(by + ray_packet::width, y1), world, primary);
+            });
+            return traced;
+        }
+
+        tiled_framebuffer::for_each_morton(x1 - x0, y1 - y0, [&](int u, int v) {
+            int i = x0 + u, j = y0 + v;
+            int pixel_num = j*width + i;
+            reprojection_cache::sample result;
+            if (!reuse_pixel(i, j, pixel_num, result)) {
+                for (int s = 0; s < samples_per_pixel; s++) {
+                    ray r(lookfrom, pixel_direction(i, j, sample_offset(s)));
+                    hit_record rec;
+                    bool hit = primary.hit(r, 0, INFINITY, rec);
+                    result.sum += shade(r, hit, rec, pixel_num, s, world);
+                    if (s == 0) {
+                        result.hit = hit;
+                        result.position = hit ? rec.p : r.direction();
+                    }
+                }
+                ++traced;
+            }
+            store_pixel(i, j, result);
+        });
+        return traced;
+    }
+
+    // Traces the block [x0, x1) x [y0, y1), at most ray_packet::width square, as one packet per
+    // sample and stores the shaded block in the framebuffer. Every pixel of a packet uses the same
+    // sub-pixel offset, so the corner rays still bound the packet. Lanes outside a partial block
+    // repeat the last valid pixel so the packet frustum stays tight; their results are discarded.
+    // A block is reused from the reprojection cache only as a whole. Returns the pixels traced.
+    int render_packet (int x0, int y0, int x1, int y1, const hittable& world, const hittable& primary) {
+        reprojection_cache::sample block[ray_packet::size];
+        bool reused = true;
+        for (int j = y0; j < y1 && reused; j++) {
+            for (int i = x0; i < x1 && reused; i++) {
+                reused = reuse_pixel(i, j, j*width + i, block[(j - y0)*ray_packet::width + (i - x0)]);
+            }
         }
-        for (int k = 0; k < num_threads; k++) {
-            threads.at(k).join();
+        if (reused) {
+            for (int j = y0; j < y1; j++) {
+                for (int i = x0; i < x1; i++) {
+                    store_pixel(i, j, block[(j - y0)*ray_packet::width + (i - x0)]);
+                }
+            }
+            return 0;
         }
-        // int counter = 0;
-        // for (int j = 0; j < height; j++) {
-        //     for (int i = 0; i < width; i++) {
-        //         auto pixel_center = pixel00_loc + (float(i) * pixel_delta_u) + (float(j) * pixel_delta_v);
-        //         auto ray_direction = pixel_center - lookfrom;
-        //         ray r(lookfrom, ray_direction);
-        //         color pixel_color = ray_color(r, world);
-        //
-        //         pixels[3*counter]     = (unsigned char)(pixel_color.x * 255.9);
-        //         pixels[3*counter+1]   = (unsigned char)(pixel_color.y * 255.9);
-        //         pixels[3*counter+2]   = (unsigned char)(pixel_color.z * 255.9);
-        //
-        //         ++counter;
-        //     }
-        // }
-    }
-
-
-    void render_loop (unsigned char* pixels, int start, int stop, const hittable& world) {
-        int pixel_num = start*width;
-        for (int j = start; j < stop; j++) {
-            for (int i = 0; i < width; i++) {
-                vec3 pixel_center = pixel00_loc + (float(i) * pixel_delta_u) + (float(j) * pixel_delta_v);
-                vec3 ray_direction = pixel_center - lookfrom;
-                ray r(lookfrom, ray_direction);
-                color pixel_color = ray_color(r, world);
-
-                pixels[3*pixel_num]     = (unsigned char)(pixel_color.x * 255.9);
-                pixels[3*pixel_num+1]   = (unsigned char)(pixel_color.y * 255.9);
-                pixels[3*pixel_num+2]   = (unsigned char)(pixel_color.z * 255.9);
-
-                ++pixel_num;
+
+        std::fill(std::begin(block), std::end(block), reprojection_cache::sample());
+        ray_packet packet;
+        packet_hits hits;
+        packet.origin = lookfrom;
+
+        for (int s = 0; s < samples_per_pixel; s++) {
+            vec2 offset = sample_offset(s);
+            for (int v = 0; v < ray_packet::width; v++) {
+                int j = std::min(y0 + v, y1 - 1);
+                for (int u = 0; u < ray_packet::width; u++) {
+                    int i = std::min(x0 + u, x1 - 1);
+                    packet.set_direction(v*ray_packet::width + u, pixel_direction(i, j, offset));
+                }
+            }
+            packet.set_frustum(pixel_direction(x0, y0, offset), pixel_direction(x1-1, y0, offset),
+                               pixel_direction(x1-1, y1-1, offset), pixel_direction(x0, y1-1, offset));
+
+            hits.reset(INFINITY);
+            primary.intersect_packet(packet, hits);
+            for (int lane = 0; lane < ray_packet::size; lane++) {
+                int i = x0 + lane % ray_packet::width, j = y0 + lane / ray_packet::width;
+                if (i >= x1 || j >= y1)
+                    continue;
+                // Surfaces are only resolved for the lanes that are kept, after the packet's
+                // closest hits are all known.
+                ray r = packet.get(lane);
+                bool hit = hits.hit(lane);
+                hit_record rec;
+                if (hit)
+                    resolve_surface(r, hits.get(lane), rec);
+                block[lane].sum += shade(r, hit, rec, j*width + i, s, world);
+                if (s == 0) {
+                    block[lane].hit = hit;
+                    block[lane].position = hit ? rec.p : packet.direction(lane);
+                }
+            }
+        }
+
+        for (int j = y0; j < y1; j++) {
+            for (int i = x0; i < x1; i++) {
+                store_pixel(i, j, block[(j - y0)*ray_packet::width + (i - x0)]);
             }
         }
+        return (x1 - x0) * (y1 - y0);
     }
 
 private:
 
-    int    height;          // Rendered image height
+    int    height = 0;      // Rendered image height
     vec3   pixel00_loc;    // Location of pixel 0, 0
     vec3   pixel_delta_u;  // Offset to pixel to the right
     vec3   pixel_delta_v;  // Offset to pixel below
+    std::unique_ptr<thread_pool> pool;  // Render threads, created on first render and reused
+
+    // Everything that changes what a pixel sees; accumulation restarts when any of it changes.
+    struct view_key {
+        vec3 lookfrom, forward, vup;
+        real vfov = 0;
+        int width = 0, height = 0, samples = 0;
+        bool path_tracing = false;
+        int max_depth = 0, roulette_depth = 0;
+        sampler::sequence sampling = sampler::sequence::sobol;
+
+        bool operator==(const view_key&) const = default;
+    };
+
+    view_key last_view;
+    tiled_framebuffer framebuffer;    // Per-pixel sum of this frame's samples, plus in progressive
+                                      // mode those of earlier frames
+    int accumulated = 0;              // Samples per pixel of earlier frames in framebuffer
+
+    reprojection_cache history;       // Hit points and colors of the previous frame
+    bool record_history = false;      // This frame's results go into the reprojection cache
+    bool reuse_history = false;       // This frame reuses reprojected pixels
+    int refresh_period = 1;           // Every refresh_period-th block is retraced each frame
+    int frame_index = 0;
+    long long last_traced = 0;
+    screen_bins bins;                 // Primitives per tile of the last binned frame
+
+    // Frame of render(). A binned list is binned once the view is set up, and each tile traces
+    // its primary rays against its own bin.
+    bool render_frame(unsigned char* pixels, const hittable& world, const primitive_list* binned) {
+        initialize();
+        view_key view{lookfrom, forward, vup, real(vfov), width, height, samples_per_pixel,
+                      path_tracing, max_depth, roulette_depth, sampling};
+        if (!progressive || view != last_view) {
+            accumulated = 0;
+            last_view = view;
+        }
+        if (framebuffer.resize(width, height, tile_size))
+            accumulated = 0;
+        if (progressive && accumulated >= max_accumulated_samples)
+            return false;
+
+        if (!pool || pool->size() != num_threads || pool->pins_threads() != pin_threads) {
+            pool.reset();
+            pool = std::make_unique<thread_pool>(num_threads, pin_threads);
+        }
+
+        // Frames that add samples to a still view neither reuse nor update the reprojection cache.
+        record_history = temporal_reprojection && accumulated == 0;
+        reuse_history = record_history && history.has_history();
+        if (record_history) {
+            history.resize(width, height, samples_per_pixel);
+            if (reuse_history)
+                history.reproject(*pool, [this](const reprojection_cache::sample& s, int& pixel, float& depth){
+                    return project(s, pixel, depth);
+                });
+            refresh_period = std::max(1, int(1.0f / std::max(reprojection_refresh, 1e-3f)));
+            ++frame_index;
+        } else if (!temporal_reprojection) {
+            history.invalidate();
+        }
+
+        if (binned)
+            bins.build(*binned, lookfrom, pixel00_loc, pixel_delta_u, pixel_delta_v, width, height, tile_size);
+
+        // Split the frame into tiles; idle threads steal tiles from busy ones. Each tile is
+        // converted into pixels as soon as it is done, while it is still in cache.
+        int tiles_x = (width + tile_size - 1) / tile_size;
+        int tiles_y = (height + tile_size - 1) / tile_size;
+        std::atomic<long long> traced = 0;
+        pool->parallel_for(tiles_x * tiles_y, [&](int tile, int){
+            int x0 = (tile % tiles_x) * tile_size;
+            int y0 = (tile / tiles_x) * tile_size;
+            int x1 = std::min(x0 + tile_size, width), y1 = std::min(y0 + tile_size, height);
+            if (binned)
+                traced += render_loop(x0, y0, x1, y1, world, bins.tile(*binned, tile));
+            else
+                traced += render_loop(x0, y0, x1, y1, world, world);
+            framebuffer.detile(pixels, x0, y0, x1, y1, accumulated + samples_per_pixel, path_tracing);
+        });
+        last_traced = traced;
+        if (progressive)
+            accumulated += samples_per_pixel;
+        if (record_history)
+            history.end_frame();
+        return true;
+    }
 
     void initialize() {
-        height = int(width / aspect_ratio);
+        height = image_height > 0 ? image_height : int(width / aspect_ratio);
 
         // Determine viewport dimensions.
-        float focal_length = length(lookfrom - lookat);
-        float theta = radians(vfov);
-        float h = std::tan(theta/2);
-        float viewport_height = 2 * h * focal_length;
-        float viewport_width = viewport_height * (float(width)/height);
+        real focal_length = length(lookfrom - lookat);
+        real theta = glm::radians(real(vfov));
+        real h = std::tan(theta/2);
+        real viewport_height = 2 * h * focal_length;
+        real viewport_width = viewport_height * (real(width)/height);
 
         // Calculate the u,v,w unit basis vectors for the camera coordinate frame.
-        forward.x = cos(radians(yaw)) * cos(radians(pitch));
-        forward.y = sin(radians(pitch));
-        forward.z = sin(radians(yaw)) * cos(radians(pitch));
+        real yaw_rad = glm::radians(real(yaw)), pitch_rad = glm::radians(real(pitch));
+        forward.x = std::cos(yaw_rad) * std::cos(pitch_rad);
+        forward.y = std::sin(pitch_rad);
+        forward.z = std::sin(yaw_rad) * std::cos(pitch_rad);
         forward = normalize(forward);
         right = normalize(cross(vup, forward));
         up = cross(forward, right);
@@ -110,26 +340,140 @@ private:
         vec3 viewport_v = viewport_height * up;  // Vector down viewport vertical edge
 
         // Calculate the horizontal and vertical delta vectors from pixel to pixel.
-        pixel_delta_u = viewport_u / float(width);
-        pixel_delta_v = viewport_v / float(height);
+        pixel_delta_u = viewport_u / real(width);
+        pixel_delta_v = viewport_v / real(height);
 
         // Calculate the location of the upper left pixel.
-        auto viewport_upper_left = lookfrom - (focal_length * forward) - viewport_u/2.0f - viewport_v/2.0f;
-        pixel00_loc = viewport_upper_left + 0.5f * (pixel_delta_u + pixel_delta_v);
+        auto viewport_upper_left = lookfrom - (focal_length * forward) - viewport_u/real(2) - viewport_v/real(2);
+        pixel00_loc = viewport_upper_left + real(0.5) * (pixel_delta_u + pixel_delta_v);
     }
 
 
-    color ray_color(const ray& r, const hittable& world) {
-        color col;;
-        hit_record rec;
-        if (world.hit(r, 0, INFINITY, rec)) {
-            return 0.5f * (rec.normal + color(1,1,1));
-        } else {
-            vec3 unit_direction = normalize(r.direction());
-            float a = 0.5f*(unit_direction.y + 1.0f);
-            col = a*color(0.0, 0.15, 0.3) + (1.0f-a)*color(0.0, 0.05, 0.1);
+    // Direction from lookfrom through pixel (i, j), offset from the pixel center by a fraction
+    // of a pixel in [-0.5, 0.5)^2.
+    vec3 pixel_direction(int i, int j, vec2 offset = vec2(0, 0)) const {
+        return pixel00_loc + ((real(i) + offset.x) * pixel_delta_u) + ((real(j) + offset.y) * pixel_delta_v) - lookfrom;
+    }
+
+    // Sub-pixel offset of sample s of the current frame. A single sample goes through the pixel
+    // center; more samples follow the R2 low-discrepancy sequence, which covers the pixel evenly
+    // for any count. Progressive frames continue the sequence where the previous frame stopped.
+    // The offset is shared by every pixel, which ray packets rely on; the per-pixel decorrelated
+    // numbers of the path bounces come from a sampler instead (see shade()).
+    vec2 sample_offset(int s) const {
+        s += accumulated;
+        if (s == 0 && samples_per_pixel <= 1)
+            return vec2(0, 0);
+        real u = real(0.5) + real(0.7548776662) * real(s);
+        real v = real(0.5) + real(0.5698402910) * real(s);
+        return vec2(u - std::floor(u) - real(0.5), v - std::floor(v) - real(0.5));
+    }
+
+    // Maps a cached sample to the pixel whose center ray passes closest to its hit point (or, for
+    // background, its direction), along with its depth along the view direction. False if the
+    // point is behind the camera or off screen.
+    bool project(const reprojection_cache::sample& s, int& pixel, float& depth) const {
+        vec3 d = s.hit ? s.position - lookfrom : s.position;
+        real z = -dot(d, forward);      // The camera looks along -forward
+        if (z <= 0)
+            return false;
+        real plane_z = -dot(pixel00_loc - lookfrom, forward);
+        vec3 q = d * (plane_z / z) + lookfrom - pixel00_loc;
+        real u = std::floor(dot(q, pixel_delta_u) / dot(pixel_delta_u, pixel_delta_u) + real(0.5));
+        real v = std::floor(dot(q, pixel_delta_v) / dot(pixel_delta_v, pixel_delta_v) + real(0.5));
+        if (!(u >= 0 && u < width && v >= 0 && v < height))
+            return false;
+        pixel = int(v) * width + int(u);
+        depth = s.hit ? float(z) : INFINITY;
+        return true;
+    }
+
+    // Fetches the reprojected result for pixel (i, j), unless this frame traces it anyway: no
+    // history, nothing reprojected there, or its block is due for a refresh. Refreshed blocks
+    // rotate through the screen so that every block is retraced every refresh_period frames.
+    // Background is reshaded for the pixel's own rays, which needs no tracing and keeps
+    // reprojected background from drifting off the pixel grid.
+    bool reuse_pixel(int i, int j, int pixel_num, reprojection_cache::sample& out) const {
+        if (!reuse_history)
+            return false;
+        int bx = i / ray_packet::width, by = j / ray_packet::width;
+        if ((bx + 3*by + frame_index) % refresh_period == 0)
+            return false;
+        if (!history.lookup(pixel_num, out))
+            return false;
+        if (!out.hit) {
+            out.position = pixel_direction(i, j, sample_offset(0));
+            out.sum = color(0, 0, 0);
+            for (int s = 0; s < samples_per_pixel; s++) {
+                out.sum += background(pixel_direction(i, j, sample_offset(s)));
+            }
+        }
+        return true;
+    }
+
+    // Adds this frame's samples of pixel (i, j) to the framebuffer, on top of the accumulated
+    // samples of earlier frames in progressive mode. Also records the pixel for the next frame's
+    // reprojection.
+    void store_pixel(int i, int j, const reprojection_cache::sample& result) {
+        if (record_history)
+            history.store(j*width + i, result);
+        color& total = framebuffer.at(i, j);
+        total = accumulated == 0 ? result.sum : total + result.sum;
+    }
+
+    // Color of sample s of pixel pixel_num, whose primary ray r hit rec (if hit).
+    color shade(const ray& r, bool hit, const hit_record& rec, int pixel_num, int s, const hittable& world) const {
+        if (!hit)
+            return background(r.direction());
+        if (!path_tracing)
+            return hit_color(rec);
+        sampler gen(sampling, uint32_t(pixel_num), uint32_t(accumulated + s));
+        return trace_path(r, rec, world, gen);
+    }
+
+    // Radiance along a path from its first hit, bounce by bounce: a loop over a single ray and hit
+    // record, without recursion or allocation. The path ends when it leaves the scene, is
+    // absorbed, reaches max_depth bounces or, past roulette_depth bounces, loses at Russian
+    // roulette: it survives with a probability that follows its throughput, and survivors are
+    // weighted up to keep the estimate unbiased.
+    color trace_path(ray r, hit_record rec, const hittable& world, sampler& gen) const {
+        color radiance(0, 0, 0);
+        color throughput(1, 1, 1);
+        for (int depth = 0; ; depth++) {
+            if (rec.mat == nullptr)
+                return radiance + throughput * hit_color(rec);
+            radiance += throughput * rec.mat->emitted();
+
+            color attenuation;
+            ray scattered;
+            if (depth >= max_depth || !rec.mat->scatter(r, rec, gen, attenuation, scattered))
+                break;
+            throughput *= attenuation;
+            if (depth >= roulette_depth) {
+                real survival = std::clamp(std::max({throughput.x, throughput.y, throughput.z}), real(0.05), real(1));
+                if (gen.uniform() >= survival)
+                    break;
+                throughput /= survival;
+            }
+
+            r = scattered;
+            if (!world.hit(r, real(0.001), INFINITY, rec)) {
+                radiance += throughput * background(r.direction());
+                break;
+            }
         }
-        return col;
+        return radiance;
+    }
+
+
+    color hit_color(const hit_record& rec) const {
+        return real(0.5) * (rec.normal + color(1,1,1));
+    }
+
+    color background(const vec3& direction) const {
+        vec3 unit_direction = normalize(direction);
+        real a = real(0.5)*(unit_direction.y + 1);
+        return a*color(0.0, 0.15, 0.3) + (1-a)*color(0.0, 0.05, 0.1);
     }
 };
 
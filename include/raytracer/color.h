@@ -3,8 +3,22 @@
 
 #include "raytracer.h"
 #include <fstream>
+#include <string>
 
-using namespace glm;
 using color = vec3;
 
-#endif
\ No newline at end of file
+// Writes an 8-bit RGB pixel buffer, as filled by camera::render, to a binary PPM (P6) file.
+// camera::render stores the bottom row first (the order glTexImage2D expects), so rows are
+// written in reverse to get an upright image.
+inline bool write_ppm(const std::string& path, const unsigned char* pixels, int width, int height) {
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        return false;
+    out << "P6\n" << width << ' ' << height << "\n255\n";
+    for (int j = height - 1; j >= 0; j--) {
+        out.write(reinterpret_cast<const char*>(pixels) + std::streamsize(j) * width * 3, std::streamsize(width) * 3);
+    }
+    return bool(out);
+}
+
+#endif
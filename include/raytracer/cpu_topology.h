@@ -0,0 +1,74 @@
+#ifndef CPU_TOPOLOGY_H
+#define CPU_TOPOLOGY_H
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+
+// Returns the logical CPUs this process may run on, ordered so that consecutive entries land on
+// different physical cores first and only then fill in the SMT siblings. Pinning worker i to
+// entry i therefore gives each of the first (num physical cores) workers a core of its own.
+// Returns an empty list where the OS offers no hard affinity (e.g. macOS).
+inline std::vector<int> cpu_placement_order() {
+    std::vector<int> order;
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return order;
+
+    // (SMT sibling rank, package, core, cpu) for each allowed CPU.
+    std::vector<std::tuple<int, int, int, int>> cpus;
+    std::vector<std::pair<int, int>> seen_cores;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+
+        std::string base = "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/";
+        int package = 0, core = cpu;
+        std::ifstream(base + "physical_package_id") >> package;
+        std::ifstream(base + "core_id") >> core;
+
+        auto id = std::make_pair(package, core);
+        int rank = int(std::count(seen_cores.begin(), seen_cores.end(), id));
+        seen_cores.push_back(id);
+        cpus.emplace_back(rank, package, core, cpu);
+    }
+    std::sort(cpus.begin(), cpus.end());
+    for (const auto& c : cpus) {
+        order.push_back(std::get<3>(c));
+    }
+#endif
+    return order;
+}
+
+// Pins the calling thread to one logical CPU. Returns false if that isn't supported or fails.
+inline bool pin_current_thread(int cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Default render thread count: every hardware thread the machine reports.
+inline int default_thread_count() {
+    unsigned int n = std::thread::hardware_concurrency();
+    return n > 0 ? int(n) : 1;
+}
+
+#endif //CPU_TOPOLOGY_H
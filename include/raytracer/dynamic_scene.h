@@ -0,0 +1,251 @@
+#ifndef DYNAMIC_SCENE_H
+#define DYNAMIC_SCENE_H
+
+#include "raytracer.h"
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "primitive.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+
+// Slot of a dynamic_scene's BVH: a primitive and the handle it was added under. Removed
+// primitives leave an empty slot (no_handle) behind, which has no bounds and is never hit.
+struct dynamic_primitive {
+    static constexpr uint32_t no_handle = UINT32_MAX;
+
+    primitive shape;
+    uint32_t handle = no_handle;
+};
+
+// Object interface of dynamic_primitive, so basic_bvh can hold it by value (see primitive.h).
+inline bool intersect_object(const dynamic_primitive& object, const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) {
+    return object.handle != dynamic_primitive::no_handle && intersect_object(object.shape, r, ray_tmin, ray_tmax, hit);
+}
+
+inline void intersect_object_packet(const dynamic_primitive& object, const ray_packet& packet, packet_hits& hits) {
+    if (object.handle != dynamic_primitive::no_handle)
+        intersect_object_packet(object.shape, packet, hits);
+}
+
+inline bool occluded_object(const dynamic_primitive& object, const ray& r, real ray_tmin, real ray_tmax) {
+    return object.handle != dynamic_primitive::no_handle && occluded_object(object.shape, r, ray_tmin, ray_tmax);
+}
+
+inline void occluded_object_packet(const dynamic_primitive& object, const ray_packet& packet, packet_occlusion& occlusion) {
+    if (object.handle != dynamic_primitive::no_handle)
+        occluded_object_packet(object.shape, packet, occlusion);
+}
+
+inline aabb object_bounds(const dynamic_primitive& object) {
+    return object.handle != dynamic_primitive::no_handle ? object_bounds(object.shape) : aabb();
+}
+
+
+// Primitives that move, appear and disappear between frames, e.g. bouncing balls. Changes are
+// made through handles and collected until update(), which brings the BVH up to date at the
+// least cost that keeps it fast:
+//   - Every update refits the boxes bottom-up, which is all that small motion needs.
+//   - A subtree whose two children overlap noticeably more than when it was built has had its
+//     objects drift across each other; it is rebuilt on its own.
+//   - If the tree's SAH cost still grew by rebuild_cost_ratio since the last full build, or
+//     primitives were added with no empty slot to take them, the whole tree is rebuilt.
+// An animated scene thus pays O(N) box updates per frame plus rebuilds where motion demands
+// them, rather than a full build every frame.
+class dynamic_scene final : public hittable {
+public:
+    using handle = uint32_t;
+
+    float rebuild_cost_ratio = 1.5f;    // Full rebuild once the SAH cost grew by this factor
+    float overlap_growth = 0.25f;       // Subtree rebuild once the children's overlap, as a
+                                        // fraction of the parent's area, grew by this much
+
+    // What the last update() did, for tuning and statistics.
+    int subtree_rebuilds = 0;
+    bool full_rebuild = false;
+
+    handle add(const primitive& object) {
+        handle h;
+        if (free_handles.empty()) {
+            h = handle(slots.size());
+            slots.push_back(unplaced);
+        } else {
+            h = free_handles.back();
+            free_handles.pop_back();
+        }
+        if (free_slots.empty()) {
+            slots[h] = unplaced;
+            pending.push_back(dynamic_primitive{object, h});
+        } else {
+            slots[h] = free_slots.back();
+            free_slots.pop_back();
+            tree.set_object(slots[h], dynamic_primitive{object, h});
+        }
+        return h;
+    }
+
+    // Replaces a primitive, e.g. by a moved copy.
+    void set(handle h, const primitive& object) {
+        if (slots[h] == unplaced) {
+            for (auto& p : pending) {
+                if (p.handle == h)
+                    p.shape = object;
+            }
+        } else {
+            tree.set_object(slots[h], dynamic_primitive{object, h});
+        }
+    }
+
+    void remove(handle h) {
+        if (slots[h] == unplaced) {
+            pending.erase(std::find_if(pending.begin(), pending.end(),
+                                       [&](const dynamic_primitive& p){ return p.handle == h; }));
+        } else {
+            tree.set_object(slots[h], dynamic_primitive{tree.object_array()[slots[h]].shape, dynamic_primitive::no_handle});
+            free_slots.push_back(slots[h]);
+        }
+        slots[h] = removed;
+        free_handles.push_back(h);
+    }
+
+    const primitive& get(handle h) const {
+        if (slots[h] == unplaced) {
+            for (const auto& p : pending) {
+                if (p.handle == h)
+                    return p.shape;
+            }
+        }
+        return tree.object_array()[slots[h]].shape;
+    }
+
+    // Brings the BVH up to date with the changes since the last call. Call it once per frame,
+    // before rendering.
+    void update() {
+        subtree_rebuilds = 0;
+        full_rebuild = !pending.empty() || tree.node_array().size() > 3 * tree.object_array().size();
+        if (!full_rebuild) {
+            tree.refit();
+            rebuild_degraded_subtrees();
+            full_rebuild = tree.sah_cost() > rebuild_cost_ratio * built_cost;
+        }
+        if (full_rebuild) {
+            std::vector<dynamic_primitive> objects;
+            objects.reserve(tree.object_array().size() + pending.size());
+            for (const auto& object : tree.object_array()) {
+                if (object.handle != dynamic_primitive::no_handle)
+                    objects.push_back(object);
+            }
+            objects.insert(objects.end(), pending.begin(), pending.end());
+            pending.clear();
+            tree = basic_bvh<dynamic_primitive>(std::move(objects));
+            built_overlap.clear();
+            record_overlap(0);
+            built_cost = tree.sah_cost();
+        }
+        if (full_rebuild || subtree_rebuilds > 0)
+            find_slots();
+    }
+
+    bool intersect(const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) const override {
+        return tree.intersect(r, ray_tmin, ray_tmax, hit);
+    }
+
+    void intersect_packet(const ray_packet& packet, packet_hits& hits) const override {
+        tree.intersect_packet(packet, hits);
+    }
+
+    bool occluded(const ray& r, real ray_tmin, real ray_tmax) const override {
+        return tree.occluded(r, ray_tmin, ray_tmax);
+    }
+
+    void occluded_packet(const ray_packet& packet, packet_occlusion& occlusion) const override {
+        tree.occluded_packet(packet, occlusion);
+    }
+
+    aabb bounding_box() const override { return tree.bounding_box(); }
+
+private:
+    static constexpr uint32_t unplaced = UINT32_MAX;        // Added, waiting for a rebuild
+    static constexpr uint32_t removed = UINT32_MAX - 1;
+
+    basic_bvh<dynamic_primitive> tree;
+    std::vector<uint32_t> slots;            // Slot in tree.object_array() of every handle
+    std::vector<handle> free_handles;
+    std::vector<uint32_t> free_slots;       // Slots emptied by remove()
+    std::vector<dynamic_primitive> pending; // Added with no free slot to take them
+    std::vector<float> built_overlap;       // Children's overlap of every node when it was built
+    float built_cost = 0.0f;
+
+    // Area of the intersection of a node's children, relative to the node's own area.
+    float overlap(uint32_t index) const {
+        const auto& nodes = tree.node_array();
+        const auto& node = nodes[index];
+        float area = node.bbox.surface_area();
+        if (node.is_leaf() || area <= 0)
+            return 0.0f;
+        const aabb& a = nodes[node.first].bbox;
+        const aabb& b = nodes[node.first + 1].bbox;
+        aabb common;
+        common.min = glm::max(a.min, b.min);
+        common.max = glm::min(a.max, b.max);
+        return common.surface_area() / area;
+    }
+
+    // Records the overlap of every node of the subtree under index as its built state.
+    void record_overlap(uint32_t index) {
+        const auto& nodes = tree.node_array();
+        built_overlap.resize(nodes.size());
+        if (nodes.empty())
+            return;
+        std::vector<uint32_t> stack = {index};
+        while (!stack.empty()) {
+            uint32_t i = stack.back();
+            stack.pop_back();
+            built_overlap[i] = overlap(i);
+            if (!nodes[i].is_leaf()) {
+                stack.push_back(nodes[i].first);
+                stack.push_back(nodes[i].first + 1);
+            }
+        }
+    }
+
+    // Rebuilds, top-down, the highest subtrees whose children overlap too much more than they
+    // did when built.
+    void rebuild_degraded_subtrees() {
+        const auto& nodes = tree.node_array();
+        if (nodes.empty())
+            return;
+        std::vector<std::pair<uint32_t, int>> stack = {{0, 0}};    // Node, depth below the root
+        while (!stack.empty()) {
+            auto [i, depth] = stack.back();
+            stack.pop_back();
+            if (nodes[i].is_leaf())
+                continue;
+            if (overlap(i) - built_overlap[i] > overlap_growth) {
+                tree.rebuild(i, depth);
+                record_overlap(i);
+                subtree_rebuilds++;
+                continue;
+            }
+            stack.push_back({nodes[i].first, depth + 1});
+            stack.push_back({nodes[i].first + 1, depth + 1});
+        }
+    }
+
+    // Rebuilds reorder the objects; finds every handle's slot again.
+    void find_slots() {
+        free_slots.clear();
+        const auto& objects = tree.object_array();
+        for (uint32_t i = 0; i < objects.size(); i++) {
+            if (objects[i].handle == dynamic_primitive::no_handle)
+                free_slots.push_back(i);
+            else
+                slots[objects[i].handle] = i;
+        }
+    }
+};
+
+#endif //DYNAMIC_SCENE_H
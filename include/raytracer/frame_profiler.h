@@ -0,0 +1,276 @@
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// Per-frame instrumentation for an interactive render loop. Each frame is split into named
+// phases (input, trace, upload, ...) and, for the trace, the busy time of every render thread.
+// The last `window` frames that ran a phase feed its rolling p50/p95/p99 statistics, so a phase
+// that only some frames run (a trace finished by another thread) isn't diluted by the others;
+// imbalance likewise counts only frames with thread timings. While a capture is running,
+// every frame is also kept so it can be exported as CSV or as a Chrome trace
+// (load the JSON in chrome://tracing or https://ui.perfetto.dev).
+//
+//     profiler.begin_frame();
+//     { auto p = profiler.phase("trace"); cam.render(pixels, world); }
+//     profiler.add_threads(*cam.render_threads());
+//     profiler.end_frame();
+class frame_profiler {
+public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr int window = 240;            // Frames kept for the rolling percentiles
+    static constexpr size_t max_captured = 100000; // Frames kept by one capture
+
+    // Times the enclosing scope as one phase of the current frame.
+    class scoped_phase {
+    public:
+        scoped_phase(frame_profiler& profiler, const char* name)
+            : profiler(profiler), name(name), start(clock::now()) {}
+        ~scoped_phase() { profiler.add_phase(name, start, clock::now()); }
+
+    private:
+        frame_profiler& profiler;
+        const char* name;
+        clock::time_point start;
+    };
+
+    void begin_frame() {
+        current = frame{};
+        current.start = clock::now();
+    }
+
+    scoped_phase phase(const char* name) { return scoped_phase(*this, name); }
+
+    void add_phase(const char* name, clock::time_point start, clock::time_point end) {
+        current.phases.push_back({phase_index(name), start, end});
+    }
+
+    // Records how long each render thread spent on tiles during the last parallel_for.
+    void add_threads(const thread_pool& pool) {
+        current.threads.clear();
+        for (int w = 0; w < pool.size(); w++) {
+            current.threads.push_back(pool.last_span(w));
+        }
+    }
+
+    // Same, for thread timings taken elsewhere (e.g. by a render thread along with its frame).
+    void add_threads(const std::vector<thread_pool::worker_span>& spans) { current.threads = spans; }
+
+    void end_frame() {
+        current.end = clock::now();
+
+        // Fold into the rolling windows: one sample per phase that ran in this frame.
+        history.resize(phase_names.size() + 2);
+        std::vector<double> totals(phase_names.size(), 0.0);
+        std::vector<bool> ran(phase_names.size(), false);
+        for (const auto& p : current.phases) {
+            totals[p.phase] += ms(p.start, p.end);
+            ran[p.phase] = true;
+        }
+        for (size_t i = 0; i < totals.size(); i++) {
+            if (ran[i])
+                push_sample(history[i], totals[i]);
+        }
+        push_sample(history[phase_names.size()], ms(current.start, current.end));
+        if (!current.threads.empty())
+            push_sample(history[phase_names.size() + 1], thread_imbalance(current));
+
+        if (capturing && captured.size() < max_captured)
+            captured.push_back(current);
+        ++frame_count;
+    }
+
+    // Rolling percentiles (milliseconds) of a phase, of "frame" for the whole frame, or of
+    // "imbalance" for the thread imbalance (%).
+    struct percentiles {
+        double p50 = 0.0, p95 = 0.0, p99 = 0.0;
+    };
+
+    percentiles stats(const std::string& name) const {
+        size_t index = phase_names.size();
+        if (name == "imbalance") {
+            index = phase_names.size() + 1;
+        } else if (name != "frame") {
+            index = std::find(phase_names.begin(), phase_names.end(), name) - phase_names.begin();
+        }
+        if (index >= history.size() || history[index].samples.empty())
+            return {};
+
+        std::vector<double> sorted = history[index].samples;
+        std::sort(sorted.begin(), sorted.end());
+        auto at = [&](double q) { return sorted[std::min(sorted.size() - 1, size_t(q * sorted.size()))]; };
+        return {at(0.50), at(0.95), at(0.99)};
+    }
+
+    // Human readable table of the rolling percentiles, for logging to the console.
+    std::string summary() const {
+        std::ostringstream out;
+        char line[128];
+        std::snprintf(line, sizeof(line), "%-12s %9s %9s %9s   (last %d frames)\n", "phase", "p50 ms", "p95 ms",
+            "p99 ms", std::min(window, int(frame_count)));
+        out << line;
+        auto row = [&](const std::string& name) {
+            percentiles p = stats(name);
+            std::snprintf(line, sizeof(line), "%-12s %9.3f %9.3f %9.3f\n", name.c_str(), p.p50, p.p95, p.p99);
+            out << line;
+        };
+        for (const auto& name : phase_names) {
+            row(name);
+        }
+        row("frame");
+        percentiles imbalance = stats("imbalance");
+        std::snprintf(line, sizeof(line), "%-12s %8.1f%% %8.1f%% %8.1f%%   (idle share of thread time)\n",
+            "imbalance", imbalance.p50, imbalance.p95, imbalance.p99);
+        out << line;
+        return out.str();
+    }
+
+    void start_capture() {
+        captured.clear();
+        capturing = true;
+    }
+
+    void stop_capture() { capturing = false; }
+
+    bool is_capturing() const { return capturing; }
+
+    // One row per captured frame: total, every phase and the busiest/average thread, in ms.
+    bool write_csv(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out)
+            return false;
+        out << "frame,frame_ms";
+        for (const auto& name : phase_names) {
+            out << ',' << name << "_ms";
+        }
+        out << ",thread_max_ms,thread_mean_ms,imbalance_pct\n";
+
+        for (size_t f = 0; f < captured.size(); f++) {
+            const frame& fr = captured[f];
+            std::vector<double> totals(phase_names.size(), 0.0);
+            for (const auto& p : fr.phases) {
+                totals[p.phase] += ms(p.start, p.end);
+            }
+            double max_busy = 0.0, sum_busy = 0.0;
+            for (const auto& t : fr.threads) {
+                max_busy = std::max(max_busy, ms(t.start, t.end));
+                sum_busy += ms(t.start, t.end);
+            }
+            out << f << ',' << ms(fr.start, fr.end);
+            for (double t : totals) {
+                out << ',' << t;
+            }
+            out << ',' << max_busy << ',' << (fr.threads.empty() ? 0.0 : sum_busy / fr.threads.size())
+                << ',' << thread_imbalance(fr) << '\n';
+        }
+        return bool(out);
+    }
+
+    // Chrome trace event format: frames and phases on tid 0, tile work of worker w on tid w+1.
+    bool write_chrome_trace(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out)
+            return false;
+        if (captured.empty())
+            return bool(out << "{\"traceEvents\":[]}\n");
+
+        clock::time_point origin = captured.front().start;
+        auto us = [&](clock::time_point t) {
+            return std::chrono::duration<double, std::micro>(t - origin).count();
+        };
+        bool first = true;
+        auto event = [&](const std::string& name, int tid, clock::time_point start, clock::time_point end) {
+            out << (first ? "" : ",\n") << "{\"name\":\"" << name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << tid
+                << ",\"ts\":" << us(start) << ",\"dur\":" << us(end) - us(start) << "}";
+            first = false;
+        };
+
+        out << "{\"traceEvents\":[\n";
+        for (const auto& fr : captured) {
+            event("frame", 0, fr.start, fr.end);
+            for (const auto& p : fr.phases) {
+                event(phase_names[p.phase], 0, p.start, p.end);
+            }
+            for (size_t w = 0; w < fr.threads.size(); w++) {
+                event("tiles (" + std::to_string(fr.threads[w].tasks) + ")", int(w) + 1,
+                    fr.threads[w].start, fr.threads[w].end);
+            }
+        }
+        out << "\n]}\n";
+        return bool(out);
+    }
+
+private:
+    struct phase_span {
+        size_t phase;
+        clock::time_point start, end;
+    };
+
+    struct frame {
+        clock::time_point start, end;
+        std::vector<phase_span> phases;
+        std::vector<thread_pool::worker_span> threads;
+    };
+
+    // Samples of one statistic, a ring buffer of the last `window` once full.
+    struct series {
+        std::vector<double> samples;
+        size_t next = 0;
+    };
+
+    std::vector<std::string> phase_names;
+    std::vector<series> history;    // Per phase, then frame, then imbalance
+    frame current;
+    std::vector<frame> captured;
+    bool capturing = false;
+    long long frame_count = 0;
+
+    size_t phase_index(const char* name) {
+        for (size_t i = 0; i < phase_names.size(); i++) {
+            if (phase_names[i] == name)
+                return i;
+        }
+        phase_names.emplace_back(name);
+        // New phases are inserted before the frame/imbalance series, which shift up by one.
+        if (history.size() >= phase_names.size() + 1)
+            history.insert(history.begin() + ptrdiff_t(phase_names.size() - 1), series());
+        return phase_names.size() - 1;
+    }
+
+    static void push_sample(series& ring, double value) {
+        if (ring.samples.size() < size_t(window)) {
+            ring.samples.push_back(value);
+        } else {
+            ring.samples[ring.next] = value;
+        }
+        ring.next = (ring.next + 1) % window;
+    }
+
+    static double ms(clock::time_point a, clock::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    }
+
+    // Share of render thread time spent idle while waiting for the slowest thread, in percent.
+    static double thread_imbalance(const frame& fr) {
+        double max_busy = 0.0, sum_busy = 0.0;
+        for (const auto& t : fr.threads) {
+            max_busy = std::max(max_busy, ms(t.start, t.end));
+            sum_busy += ms(t.start, t.end);
+        }
+        if (max_busy <= 0.0)
+            return 0.0;
+        return 100.0 * (1.0 - sum_busy / (max_busy * fr.threads.size()));
+    }
+};
+
+#endif //FRAME_PROFILER_H
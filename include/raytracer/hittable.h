@@ -3,12 +3,22 @@
 
 #include "raytracer.h"
 #include "ray.h"
+#include "aabb.h"
+#include "ray_packet.h"
 
+#include <cstdint>
+
+class hittable;
+class material;
+
+// Surface at a ray's closest hit, computed by the surface phase (see hittable::surface).
 class hit_record {
 public:
     vec3 p;
     vec3 normal;
-    double t;
+    vec2 uv;                         // Surface parameterization, each coordinate in [0, 1]
+    const material* mat = nullptr;   // Owned by the primitive that was hit
+    real t;
     bool front_face;
 
     void set_face_normal(const ray& r, const vec3& outward_normal) {
@@ -20,11 +30,133 @@ public:
     }
 };
 
+// Closest hit as found by the intersection phase: its distance and what was hit, nothing that
+// takes work to compute. Primitives fill in every field when they report a hit.
+struct ray_hit {
+    real t = 0;
+    const hittable* object = nullptr;    // Primitive that was hit
+    const hittable* instance = nullptr;  // Instance that placed it, if any (see instance.h)
+    uint32_t prim = 0;                   // Part of the object that was hit, e.g. a mesh triangle
+};
+
+// Closest hits for every ray of a ray_packet, in the form of ray_hit. t[i] doubles as the ray's
+// current tmax; object[i] is nullptr while the ray has no hit.
+class packet_hits {
+public:
+    alignas(64) float t[ray_packet::size];
+    const hittable* object[ray_packet::size];
+    const hittable* instance[ray_packet::size];
+    uint32_t prim[ray_packet::size];
+
+    void reset(float tmax) {
+        for (int i = 0; i < ray_packet::size; i++) {
+            t[i] = tmax;
+            object[i] = nullptr;
+            instance[i] = nullptr;
+        }
+    }
+
+    bool hit(int i) const { return object[i] != nullptr; }
+
+    void record(int i, const ray_hit& h) {
+        t[i] = float(h.t);
+        object[i] = h.object;
+        instance[i] = h.instance;
+        prim[i] = h.prim;
+    }
+
+    ray_hit get(int i) const { return ray_hit{t[i], object[i], instance[i], prim[i]}; }
+};
+
+// Which rays of a ray_packet are blocked before their t[i] (see hittable::occluded_packet).
+// Occlusion sets a ray's t[i] to -INFINITY, so packet kernels and box tests, which only look
+// for hits before t[i], skip it from then on.
+class packet_occlusion {
+public:
+    alignas(64) float t[ray_packet::size];
+
+    void reset(float tmax) {
+        for (int i = 0; i < ray_packet::size; i++) {
+            t[i] = tmax;
+        }
+    }
+
+    bool occluded(int i) const { return t[i] == -INFINITY; }
+
+    void set_occluded(int i) { t[i] = -INFINITY; }
+
+    bool all_occluded() const {
+        for (int i = 0; i < ray_packet::size; i++) {
+            if (t[i] != -INFINITY)
+                return false;
+        }
+        return true;
+    }
+};
+
+// Anything a ray can hit. Finding a hit runs in two phases. intersect() finds the closest hit and
+// records only its distance and identity, so traversal does no more per candidate than the
+// intersection test itself. surface() then computes the position, normal, UV and material, once
+// per ray and for the closest hit only. hit() runs both. occluded() answers only whether there is
+// any hit at all, e.g. for shadow and visibility rays, and stops at the first one found.
 class hittable {
 public:
     virtual ~hittable() = default;
 
-    virtual bool hit(const ray& r, double ray_tmin, double ray_tmax, hit_record& rec) const = 0;
+    // Finds the closest hit with t in (ray_tmin, ray_tmax). Leaves hit untouched on a miss, so
+    // containers can pass one ray_hit to all their children with a shrinking ray_tmax.
+    virtual bool intersect(const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) const = 0;
+
+    // Intersects a whole packet, keeping each ray's hit only if it is closer than hits.t[i].
+    // The default traces the rays one by one; primitives and acceleration structures override it.
+    virtual void intersect_packet(const ray_packet& packet, packet_hits& hits) const {
+        for (int i = 0; i < ray_packet::size; i++) {
+            ray_hit h;
+            if (intersect(packet.get(i), packet.tmin, hits.t[i], h))
+                hits.record(i, h);
+        }
+    }
+
+    // True if anything is hit with t in (ray_tmin, ray_tmax). The default runs intersect(), which
+    // is as cheap for a single primitive; containers override it to stop at the first hit.
+    virtual bool occluded(const ray& r, real ray_tmin, real ray_tmax) const {
+        ray_hit h;
+        return intersect(r, ray_tmin, ray_tmax, h);
+    }
+
+    // Marks every ray of the packet that is blocked between packet.tmin and occlusion.t[i].
+    // The default tests the rays that are still open one by one.
+    virtual void occluded_packet(const ray_packet& packet, packet_occlusion& occlusion) const {
+        for (int i = 0; i < ray_packet::size; i++) {
+            if (!occlusion.occluded(i) && occluded(packet.get(i), packet.tmin, occlusion.t[i]))
+                occlusion.set_occluded(i);
+        }
+    }
+
+    // Fills rec for a hit that intersect() reported with this object as ray_hit::object (or as
+    // ray_hit::instance), along the same ray. Only primitives and instances are ever asked.
+    virtual void surface(const ray& r, const ray_hit& hit, hit_record& rec) const {
+        (void)r; (void)hit; (void)rec;
+    }
+
+    virtual aabb bounding_box() const = 0;
+
+    // Closest hit and its surface.
+    bool hit(const ray& r, real ray_tmin, real ray_tmax, hit_record& rec) const;
 };
 
-#endif
\ No newline at end of file
+// Surface phase of a hit found by intersect() along r.
+inline void resolve_surface(const ray& r, const ray_hit& hit, hit_record& rec) {
+    rec.t = hit.t;
+    (hit.instance != nullptr ? hit.instance : hit.object)->surface(r, hit, rec);
+}
+
+inline bool hittable::hit(const ray& r, real ray_tmin, real ray_tmax, hit_record& rec) const {
+    ray_hit h;
+    if (!intersect(r, ray_tmin, ray_tmax, h))
+        return false;
+    resolve_surface(r, h, rec);
+    return true;
+}
+
+#endif
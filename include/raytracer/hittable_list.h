@@ -16,26 +16,55 @@ public:
     hittable_list() {}
     hittable_list(shared_ptr<hittable> object) { add(object); }
 
-    void clear() { objects.clear(); }
+    void clear() {
+        objects.clear();
+        bbox = aabb();
+    }
 
     void add(shared_ptr<hittable> object) {
+        bbox.expand(object->bounding_box());
         objects.push_back(object);
     }
 
-    bool hit(const ray& r, double ray_tmin, double ray_tmax, hit_record& rec) const override {
-        hit_record temp_rec;
+    bool intersect(const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) const override {
         bool hit_anything = false;
         auto closest_so_far = ray_tmax;
 
         for (const auto& object : objects) {
-            if (object->hit(r, ray_tmin, closest_so_far, temp_rec)) {
+            if (object->intersect(r, ray_tmin, closest_so_far, hit)) {
                 hit_anything = true;
-                closest_so_far = temp_rec.t;
-                rec = temp_rec;
+                closest_so_far = hit.t;
             }
         }
         return hit_anything;
     }
+
+    void intersect_packet(const ray_packet& packet, packet_hits& hits) const override {
+        for (const auto& object : objects) {
+            object->intersect_packet(packet, hits);
+        }
+    }
+
+    bool occluded(const ray& r, real ray_tmin, real ray_tmax) const override {
+        for (const auto& object : objects) {
+            if (object->occluded(r, ray_tmin, ray_tmax))
+                return true;
+        }
+        return false;
+    }
+
+    void occluded_packet(const ray_packet& packet, packet_occlusion& occlusion) const override {
+        for (const auto& object : objects) {
+            object->occluded_packet(packet, occlusion);
+            if (occlusion.all_occluded())
+                return;
+        }
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    aabb bbox;
 };
 
 #endif
\ No newline at end of file
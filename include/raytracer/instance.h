@@ -0,0 +1,139 @@
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include "raytracer.h"
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "ray_packet.h"
+
+#include <algorithm>
+#include <memory>
+
+
+// Rotation by degrees around axis (right-handed), e.g. for instance transforms.
+inline mat3 rotation(const vec3& axis, real degrees) {
+    vec3 a = normalize(axis);
+    real c = std::cos(degrees_to_radians(degrees)), s = std::sin(degrees_to_radians(degrees));
+    mat3 m;
+    m[0] = vec3(c + a.x*a.x*(1 - c),     a.y*a.x*(1 - c) + a.z*s, a.z*a.x*(1 - c) - a.y*s);
+    m[1] = vec3(a.x*a.y*(1 - c) - a.z*s, c + a.y*a.y*(1 - c),     a.z*a.y*(1 - c) + a.x*s);
+    m[2] = vec3(a.x*a.z*(1 - c) + a.y*s, a.y*a.z*(1 - c) - a.x*s, c + a.z*a.z*(1 - c));
+    return m;
+}
+
+
+// Placement of a shared geometry in the scene: the geometry (a primitive, a triangle_mesh, or a
+// whole BVH) is referenced, not copied, and seen through the affine transform
+// x -> linear * x + offset. Rays are moved into object space instead of the geometry into world
+// space, so a geometry and its acceleration structure are built once and placed any number of
+// times at the cost of one instance each (about 130 bytes), and moving an instance never touches
+// the geometry. Object-space rays keep their unnormalized direction, so hit distances carry over
+// unchanged.
+//
+// Hits inside an instance name it in ray_hit::instance, and its surface() moves the geometry's
+// surface back into world space. There is one such slot, so instances nest one level deep: the
+// geometry must not itself contain instances.
+//
+// Instances are held by value in an instance_bvh, the top-level structure over all placements.
+class instance final : public hittable {
+public:
+    instance(shared_ptr<hittable> geometry, const mat3& linear = mat3(1), const vec3& offset = vec3(0, 0, 0))
+        : object(std::move(geometry)) {
+        set_transform(linear, offset);
+    }
+
+    void set_transform(const mat3& linear, const vec3& offset) {
+        to_world = linear;
+        translation = offset;
+        to_object = glm::inverse(linear);
+
+        bbox = aabb();
+        aabb local = object->bounding_box();
+        if (local.empty())
+            return;
+        for (int corner = 0; corner < 8; corner++) {
+            vec3 p(corner & 1 ? local.max.x : local.min.x,
+                   corner & 2 ? local.max.y : local.min.y,
+                   corner & 4 ? local.max.z : local.min.z);
+            bbox.expand(to_world * p + translation);
+        }
+    }
+
+    const shared_ptr<hittable>& geometry() const { return object; }
+    const mat3& linear() const { return to_world; }
+    const vec3& offset() const { return translation; }
+
+    bool intersect(const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) const override {
+        if (!object->intersect(to_object_space(r), ray_tmin, ray_tmax, hit))
+            return false;
+        hit.instance = this;
+        return true;
+    }
+
+    void intersect_packet(const ray_packet& packet, packet_hits& hits) const override {
+        float before[ray_packet::size];
+        std::copy(std::begin(hits.t), std::end(hits.t), before);
+        object->intersect_packet(packet.transformed(to_object, translation, glm::transpose(to_world)), hits);
+        for (int i = 0; i < ray_packet::size; i++) {
+            if (hits.t[i] != before[i])
+                hits.instance[i] = this;
+        }
+    }
+
+    bool occluded(const ray& r, real ray_tmin, real ray_tmax) const override {
+        return object->occluded(to_object_space(r), ray_tmin, ray_tmax);
+    }
+
+    void occluded_packet(const ray_packet& packet, packet_occlusion& occlusion) const override {
+        object->occluded_packet(packet.transformed(to_object, translation, glm::transpose(to_world)), occlusion);
+    }
+
+    // Normals map by the inverse transpose, which keeps them perpendicular to the surface and on
+    // the same side relative to the ray, so front_face stays valid.
+    void surface(const ray& r, const ray_hit& hit, hit_record& rec) const override {
+        hit.object->surface(to_object_space(r), hit, rec);
+        rec.p = r.at(hit.t);
+        rec.normal = normalize(glm::transpose(to_object) * rec.normal);
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    shared_ptr<hittable> object;
+    mat3 to_world;
+    vec3 translation;
+    mat3 to_object;
+    aabb bbox;
+
+    ray to_object_space(const ray& r) const {
+        return ray(to_object * (r.origin() - translation), to_object * r.direction());
+    }
+};
+
+// Object interface of instance, so basic_bvh can hold instances by value (see primitive.h).
+inline bool intersect_object(const instance& object, const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) {
+    return object.intersect(r, ray_tmin, ray_tmax, hit);
+}
+
+inline void intersect_object_packet(const instance& object, const ray_packet& packet, packet_hits& hits) {
+    object.intersect_packet(packet, hits);
+}
+
+inline bool occluded_object(const instance& object, const ray& r, real ray_tmin, real ray_tmax) {
+    return object.occluded(r, ray_tmin, ray_tmax);
+}
+
+inline void occluded_object_packet(const instance& object, const ray_packet& packet, packet_occlusion& occlusion) {
+    object.occluded_packet(packet, occlusion);
+}
+
+inline aabb object_bounds(const instance& object) {
+    return object.bounding_box();
+}
+
+// Top-level acceleration structure: a BVH over instances, whose geometries carry their own
+// (bottom-level) structures. Rebuilding it after instances moved only sorts the instance boxes.
+using instance_bvh = basic_bvh<instance>;
+
+#endif //INSTANCE_H
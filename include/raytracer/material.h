@@ -0,0 +1,108 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include "raytracer.h"
+#include "color.h"
+#include "hittable.h"
+#include "ray.h"
+#include "sampler.h"
+
+
+// Surface description, stored by value in every primitive. One of four kinds, picked by a switch
+// rather than a virtual call, so that shading a bounce costs no indirection or allocation:
+//     material::diffuse(albedo)         Lambertian reflector
+//     material::metal(albedo, fuzz)     mirror, blurred by fuzz in [0, 1]
+//     material::dielectric(ior)         glass-like refractor with index of refraction ior
+//     material::emissive(radiance)      light source; absorbs everything that hits it
+class material {
+public:
+    enum class kind { diffuse, metal, dielectric, emissive };
+
+    static material diffuse(const color& albedo) { return material(kind::diffuse, albedo); }
+
+    static material metal(const color& albedo, real fuzz) {
+        material m(kind::metal, albedo);
+        m.fuzz = std::min(fuzz, real(1));
+        return m;
+    }
+
+    static material dielectric(real index_of_refraction) {
+        material m(kind::dielectric, color(1, 1, 1));
+        m.ior = index_of_refraction;
+        return m;
+    }
+
+    static material emissive(const color& radiance) {
+        material m(kind::emissive, color(0, 0, 0));
+        m.emission = radiance;
+        return m;
+    }
+
+    kind type() const { return surface; }
+
+    color emitted() const { return emission; }
+
+    // Samples the continuation of a path that hit this surface. Returns false if the path is
+    // absorbed; otherwise sets the scattered ray and the attenuation of its contribution.
+    bool scatter(const ray& r_in, const hit_record& rec, sampler& gen, color& attenuation, ray& scattered) const {
+        switch (surface) {
+        case kind::diffuse: {
+            vec3 direction = rec.normal + gen.unit_vector();
+            if (dot(direction, direction) < real(1e-12))
+                direction = rec.normal;
+            scattered = ray(rec.p, direction);
+            attenuation = albedo;
+            return true;
+        }
+        case kind::metal: {
+            vec3 reflected = reflect(normalize(r_in.direction()), rec.normal) + fuzz * gen.unit_vector();
+            scattered = ray(rec.p, reflected);
+            attenuation = albedo;
+            return dot(reflected, rec.normal) > 0;
+        }
+        case kind::dielectric: {
+            real ri = rec.front_face ? 1 / ior : ior;
+            vec3 unit_direction = normalize(r_in.direction());
+            real cos_theta = std::min(dot(-unit_direction, rec.normal), real(1));
+            real sin_theta = std::sqrt(1 - cos_theta*cos_theta);
+            bool cannot_refract = ri * sin_theta > 1;
+            vec3 direction = cannot_refract || reflectance(cos_theta, ri) > gen.uniform()
+                ? reflect(unit_direction, rec.normal)
+                : refract(unit_direction, rec.normal, ri);
+            scattered = ray(rec.p, direction);
+            attenuation = albedo;
+            return true;
+        }
+        case kind::emissive:
+            return false;
+        }
+        return false;
+    }
+
+private:
+    kind  surface;
+    color albedo;
+    color emission = color(0, 0, 0);
+    real  fuzz = 0;
+    real  ior = 1;
+
+    material(kind surface, const color& albedo) : surface(surface), albedo(albedo) {}
+
+    static vec3 reflect(const vec3& v, const vec3& n) { return v - 2 * dot(v, n) * n; }
+
+    static vec3 refract(const vec3& uv, const vec3& n, real etai_over_etat) {
+        real cos_theta = std::min(dot(-uv, n), real(1));
+        vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
+        vec3 r_out_parallel = -std::sqrt(std::abs(1 - dot(r_out_perp, r_out_perp))) * n;
+        return r_out_perp + r_out_parallel;
+    }
+
+    // Schlick's approximation of the Fresnel reflectance.
+    static real reflectance(real cosine, real refraction_index) {
+        real r0 = (1 - refraction_index) / (1 + refraction_index);
+        r0 = r0*r0;
+        return r0 + (1 - r0) * std::pow(1 - cosine, real(5));
+    }
+};
+
+#endif //MATERIAL_H
@@ -0,0 +1,592 @@
+#ifndef MESH_IO_H
+#define MESH_IO_H
+
+#include "raytracer.h"
+#include "cpu_topology.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define RAYTRACER_HAS_MMAP
+#else
+#include <fstream>
+#endif
+
+
+// Read-only view of a whole file. Mapped into memory where the platform has mmap, so the pages are
+// read in on demand by whichever parser thread touches them first; otherwise read in one go.
+class mapped_file {
+public:
+    explicit mapped_file(const std::string& path) {
+#ifdef RAYTRACER_HAS_MMAP
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat info;
+        if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* p = ::mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                ::madvise(p, size_t(info.st_size), MADV_WILLNEED);
+                bytes = static_cast<const char*>(p);
+                length = size_t(info.st_size);
+            }
+        }
+        ::close(fd);
+#else
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in)
+            return;
+        buffer.resize(size_t(in.tellg()));
+        in.seekg(0);
+        if (in.read(buffer.data(), std::streamsize(buffer.size()))) {
+            bytes = buffer.data();
+            length = buffer.size();
+        }
+#endif
+    }
+
+    ~mapped_file() {
+#ifdef RAYTRACER_HAS_MMAP
+        if (bytes != nullptr)
+            ::munmap(const_cast<char*>(bytes), length);
+#endif
+    }
+
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    bool is_open() const { return bytes != nullptr; }
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+
+private:
+    const char* bytes = nullptr;
+    size_t length = 0;
+#ifndef RAYTRACER_HAS_MMAP
+    std::vector<char> buffer;
+#endif
+};
+
+
+// Vertex and index buffers of a triangle mesh, as loaded from a file (see triangle_mesh).
+struct mesh_data {
+    std::vector<vec3> positions;
+    std::vector<uint32_t> indices;      // Three per triangle
+};
+
+
+namespace mesh_io_detail {
+
+// Number of work chunks per thread; more than one evens out chunks of unequal cost.
+constexpr int chunks_per_thread = 4;
+
+inline bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+
+inline void skip_spaces(const char*& p, const char* end) {
+    while (p < end && is_space(*p))
+        ++p;
+}
+
+inline void skip_line(const char*& p, const char* end) {
+    const char* newline = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+    p = newline != nullptr ? newline + 1 : end;
+}
+
+// Decimal floating point number, e.g. "-1.5e-3". Returns false if p doesn't start with one.
+// Much faster than strtof, and needs no terminating character after the number.
+inline bool parse_float(const char*& p, const char* end, float& out) {
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char* s = p;
+    bool negative = s < end && *s == '-';
+    if (s < end && (*s == '-' || *s == '+'))
+        ++s;
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    for (; s < end && *s >= '0' && *s <= '9'; ++s, ++digits) {
+        if (mantissa < 100000000000000000ULL)
+            mantissa = mantissa * 10 + uint64_t(*s - '0');
+        else
+            ++exponent;
+    }
+    if (s < end && *s == '.') {
+        for (++s; s < end && *s >= '0' && *s <= '9'; ++s, ++digits) {
+            if (mantissa < 100000000000000000ULL) {
+                mantissa = mantissa * 10 + uint64_t(*s - '0');
+                --exponent;
+            }
+        }
+    }
+    if (digits == 0)
+        return false;
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char* e = s + 1;
+        bool negative_exp = e < end && *e == '-';
+        if (e < end && (*e == '-' || *e == '+'))
+            ++e;
+        if (e < end && *e >= '0' && *e <= '9') {
+            int value = 0;
+            for (; e < end && *e >= '0' && *e <= '9'; ++e)
+                value = std::min(value * 10 + (*e - '0'), 1000);
+            exponent += negative_exp ? -value : value;
+            s = e;
+        }
+    }
+    double value = double(mantissa);
+    while (exponent > 22) { value *= 1e22; exponent -= 22; }
+    while (exponent < -22) { value /= 1e22; exponent += 22; }
+    value = exponent >= 0 ? value * powers[exponent] : value / powers[-exponent];
+    out = float(negative ? -value : value);
+    p = s;
+    return true;
+}
+
+inline bool parse_int(const char*& p, const char* end, int64_t& out) {
+    const char* s = p;
+    bool negative = s < end && *s == '-';
+    if (s < end && (*s == '-' || *s == '+'))
+        ++s;
+    if (s == end || *s < '0' || *s > '9')
+        return false;
+    int64_t value = 0;
+    for (; s < end && *s >= '0' && *s <= '9'; ++s)
+        value = value * 10 + (*s - '0');
+    out = negative ? -value : value;
+    p = s;
+    return true;
+}
+
+// Splits [0, size) into about count pieces that each end after a newline.
+inline std::vector<size_t> line_chunks(const char* data, size_t size, int count) {
+    std::vector<size_t> bounds{0};
+    for (int c = 1; c < count; c++) {
+        size_t at = std::max(bounds.back(), size * size_t(c) / size_t(count));
+        if (at >= size)
+            break;
+        const char* p = data + at;
+        skip_line(p, data + size);
+        if (size_t(p - data) > bounds.back() && size_t(p - data) < size)
+            bounds.push_back(size_t(p - data));
+    }
+    bounds.push_back(size);
+    return bounds;
+}
+
+} // namespace mesh_io_detail
+
+
+// Loads the vertex positions ("v") and faces ("f") of a Wavefront OBJ file; everything else
+// (normals, texture coordinates, groups, materials) is skipped. Polygons are split into triangle
+// fans, and negative (relative) indices are supported.
+// The file is memory mapped and cut into chunks at line boundaries, which are parsed in parallel.
+// The chunks' vertex and index counts then give each one its offset into the combined buffers.
+// Returns false and sets error if the file can't be read or refers to missing vertices.
+inline bool load_obj(const std::string& path, mesh_data& mesh, std::string& error,
+                     int num_threads = default_thread_count()) {
+    using namespace mesh_io_detail;
+    num_threads = std::max(1, num_threads);
+    mapped_file file(path);
+    if (!file.is_open()) {
+        error = "cannot read " + path;
+        return false;
+    }
+
+    struct corner {
+        int64_t index;      // 0-based; relative to the chunk's first vertex if relative is set
+        bool relative;
+    };
+    struct chunk {
+        std::vector<vec3> positions;
+        std::vector<uint32_t> indices;
+        std::vector<std::pair<size_t, int64_t>> relative;   // Slots of indices still relative to the chunk
+        bool bad_index = false;
+        size_t first_vertex = 0, first_index = 0;
+    };
+
+    const char* data = file.data();
+    std::vector<size_t> bounds = line_chunks(data, file.size(), num_threads * chunks_per_thread);
+    std::vector<chunk> chunks(bounds.size() - 1);
+    thread_pool pool(num_threads);
+
+    pool.parallel_for(int(chunks.size()), [&](int c, int) {
+        chunk& out = chunks[c];
+        std::vector<corner> face;
+        const char* p = data + bounds[c];
+        const char* end = data + bounds[c + 1];
+        while (p < end) {
+            skip_spaces(p, end);
+            if (end - p >= 2 && p[0] == 'v' && is_space(p[1])) {
+                p += 2;
+                float xyz[3] = {0, 0, 0};
+                for (float& coordinate : xyz) {
+                    skip_spaces(p, end);
+                    parse_float(p, end, coordinate);
+                }
+                out.positions.push_back(vec3(xyz[0], xyz[1], xyz[2]));
+            } else if (end - p >= 2 && p[0] == 'f' && is_space(p[1])) {
+                p += 2;
+                face.clear();
+                int64_t index;
+                while (skip_spaces(p, end), parse_int(p, end, index)) {
+                    while (p < end && !is_space(*p) && *p != '\n')     // Skip "/vt/vn"
+                        ++p;
+                    if (index == 0)
+                        out.bad_index = true;
+                    else if (index > 0)
+                        face.push_back(corner{index - 1, false});
+                    else
+                        face.push_back(corner{int64_t(out.positions.size()) + index, true});
+                }
+                for (size_t k = 1; k + 1 < face.size(); k++) {
+                    for (const corner& v : {face[0], face[k], face[k + 1]}) {
+                        if (v.relative)
+                            out.relative.emplace_back(out.indices.size(), v.index);
+                        out.indices.push_back(v.relative ? 0 : uint32_t(std::min<int64_t>(v.index, UINT32_MAX)));
+                    }
+                }
+            }
+            skip_line(p, end);
+        }
+    });
+
+    size_t vertex_count = 0, index_count = 0;
+    for (chunk& c : chunks) {
+        if (c.bad_index) {
+            error = path + ": face with vertex index 0";
+            return false;
+        }
+        c.first_vertex = vertex_count;
+        c.first_index = index_count;
+        vertex_count += c.positions.size();
+        index_count += c.indices.size();
+    }
+    if (vertex_count > UINT32_MAX) {
+        error = path + ": too many vertices";
+        return false;
+    }
+
+    mesh.positions.resize(vertex_count);
+    mesh.indices.resize(index_count);
+    std::atomic<bool> bad_index = false;
+    pool.parallel_for(int(chunks.size()), [&](int ci, int) {
+        chunk& c = chunks[ci];
+        std::copy(c.positions.begin(), c.positions.end(), mesh.positions.begin() + std::ptrdiff_t(c.first_vertex));
+        for (const auto& [slot, offset] : c.relative) {
+            int64_t index = int64_t(c.first_vertex) + offset;
+            c.indices[slot] = index >= 0 ? uint32_t(index) : UINT32_MAX;
+        }
+        for (uint32_t index : c.indices) {
+            if (index >= vertex_count)
+                bad_index = true;
+        }
+        std::copy(c.indices.begin(), c.indices.end(), mesh.indices.begin() + std::ptrdiff_t(c.first_index));
+    });
+    if (bad_index) {
+        error = path + ": face refers to a missing vertex";
+        return false;
+    }
+    return true;
+}
+
+
+namespace mesh_io_detail {
+
+enum class ply_type { invalid, int8, uint8, int16, uint16, int32, uint32, float32, float64 };
+
+inline ply_type parse_ply_type(const std::string& name) {
+    if (name == "char" || name == "int8") return ply_type::int8;
+    if (name == "uchar" || name == "uint8") return ply_type::uint8;
+    if (name == "short" || name == "int16") return ply_type::int16;
+    if (name == "ushort" || name == "uint16") return ply_type::uint16;
+    if (name == "int" || name == "int32") return ply_type::int32;
+    if (name == "uint" || name == "uint32") return ply_type::uint32;
+    if (name == "float" || name == "float32") return ply_type::float32;
+    if (name == "double" || name == "float64") return ply_type::float64;
+    return ply_type::invalid;
+}
+
+inline int ply_type_size(ply_type type) {
+    switch (type) {
+    case ply_type::int8: case ply_type::uint8: return 1;
+    case ply_type::int16: case ply_type::uint16: return 2;
+    case ply_type::int32: case ply_type::uint32: case ply_type::float32: return 4;
+    case ply_type::float64: return 8;
+    default: return 0;
+    }
+}
+
+// Reads a little-endian PLY value of the given type as a double.
+inline double read_ply_value(const char* p, ply_type type) {
+    auto load = [p](auto value) { std::memcpy(&value, p, sizeof(value)); return double(value); };
+    switch (type) {
+    case ply_type::int8: return load(int8_t());
+    case ply_type::uint8: return load(uint8_t());
+    case ply_type::int16: return load(int16_t());
+    case ply_type::uint16: return load(uint16_t());
+    case ply_type::int32: return load(int32_t());
+    case ply_type::uint32: return load(uint32_t());
+    case ply_type::float32: return load(float());
+    default: return load(double());
+    }
+}
+
+// A property of a PLY element. List properties (the face indices) have a count type.
+struct ply_property {
+    std::string name;
+    ply_type type = ply_type::invalid;
+    ply_type list_count_type = ply_type::invalid;
+    bool is_list = false;
+};
+
+struct ply_element {
+    std::string name;
+    size_t count = 0;
+    std::vector<ply_property> properties;
+};
+
+inline uint32_t read_ply_index(const char* p, int size) {
+    if (size == 1) return uint8_t(*p);
+    if (size == 2) { uint16_t v; std::memcpy(&v, p, 2); return v; }
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+} // namespace mesh_io_detail
+
+
+// Loads the vertex positions and faces of a binary little-endian PLY file. Other elements and
+// properties are skipped; polygons are split into triangle fans.
+// Vertices have a fixed size and are converted in parallel. Faces are variable-length lists: one
+// sequential pass hops from list to list to cut the faces into chunks, then the chunks are
+// converted in parallel straight into the index buffer.
+// Returns false and sets error for ASCII or big-endian files, or malformed ones.
+inline bool load_ply(const std::string& path, mesh_data& mesh, std::string& error,
+                     int num_threads = default_thread_count()) {
+    using namespace mesh_io_detail;
+    num_threads = std::max(1, num_threads);
+    mapped_file file(path);
+    if (!file.is_open()) {
+        error = "cannot read " + path;
+        return false;
+    }
+
+    // Header: plain text lines up to "end_header".
+    const char* data = file.data();
+    const char* end = data + file.size();
+    const char* p = data;
+    std::vector<ply_element> elements;
+    bool binary_le = false;
+    auto next_word = [&](const char*& q, const char* line_end) {
+        skip_spaces(q, line_end);
+        const char* start = q;
+        while (q < line_end && !is_space(*q))
+            ++q;
+        return std::string(start, q);
+    };
+    if (file.size() < 4 || std::strncmp(data, "ply", 3) != 0) {
+        error = path + ": not a PLY file";
+        return false;
+    }
+    while (true) {
+        if (p >= end) {
+            error = path + ": PLY header has no end_header";
+            return false;
+        }
+        const char* line_start = p;
+        skip_line(p, end);
+        const char* line_end = p > line_start && p[-1] == '\n' ? p - 1 : p;
+        const char* q = line_start;
+        std::string keyword = next_word(q, line_end);
+        if (keyword == "format") {
+            binary_le = next_word(q, line_end) == "binary_little_endian";
+        } else if (keyword == "element") {
+            ply_element element;
+            element.name = next_word(q, line_end);
+            element.count = size_t(std::stoull("0" + next_word(q, line_end)));
+            elements.push_back(element);
+        } else if (keyword == "property" && !elements.empty()) {
+            ply_property property;
+            std::string type = next_word(q, line_end);
+            if (type == "list") {
+                property.is_list = true;
+                property.list_count_type = parse_ply_type(next_word(q, line_end));
+                type = next_word(q, line_end);
+            }
+            property.type = parse_ply_type(type);
+            property.name = next_word(q, line_end);
+            elements.back().properties.push_back(property);
+        } else if (keyword == "end_header") {
+            break;
+        }
+    }
+    if (!binary_le) {
+        error = path + ": only binary_little_endian PLY files are supported";
+        return false;
+    }
+
+    thread_pool pool(num_threads);
+    for (const ply_element& element : elements) {
+        // Byte layout of the element: fixed-size properties, at most one list (the face indices).
+        size_t before_list = 0, after_list = 0;
+        int list_index = -1, count_size = 0, item_size = 0;
+        int xyz_offset[3] = {-1, -1, -1};
+        ply_type xyz_type[3] = {};
+        for (const ply_property& property : element.properties) {
+            int size = ply_type_size(property.type);
+            if (size == 0 || (property.is_list && ply_type_size(property.list_count_type) == 0)) {
+                error = path + ": unknown PLY type in element " + element.name;
+                return false;
+            }
+            if (property.is_list) {
+                if (list_index >= 0 || element.name != "face") {
+                    error = path + ": unsupported list property in element " + element.name;
+                    return false;
+                }
+                list_index = int(&property - element.properties.data());
+                count_size = ply_type_size(property.list_count_type);
+                item_size = size;
+                continue;
+            }
+            for (int axis = 0; axis < 3; axis++) {
+                if (property.name == std::string(1, char('x' + axis))) {
+                    xyz_offset[axis] = int(before_list);
+                    xyz_type[axis] = property.type;
+                }
+            }
+            (list_index < 0 ? before_list : after_list) += size_t(size);
+        }
+        size_t remaining = size_t(end - p);
+
+        if (element.name == "vertex") {
+            size_t stride = before_list;
+            if (xyz_offset[0] < 0 || xyz_offset[1] < 0 || xyz_offset[2] < 0 || list_index >= 0) {
+                error = path + ": vertex element without x, y and z";
+                return false;
+            }
+            if (element.count > remaining / std::max<size_t>(stride, 1) || element.count > UINT32_MAX) {
+                error = path + ": truncated vertex data";
+                return false;
+            }
+            mesh.positions.resize(element.count);
+            const char* vertices = p;
+            int chunks = num_threads * chunks_per_thread;
+            pool.parallel_for(chunks, [&](int c, int) {
+                size_t first = element.count * size_t(c) / size_t(chunks);
+                size_t last = element.count * size_t(c + 1) / size_t(chunks);
+                for (size_t i = first; i < last; i++) {
+                    const char* v = vertices + i * stride;
+                    mesh.positions[i] = vec3(real(read_ply_value(v + xyz_offset[0], xyz_type[0])),
+                                             real(read_ply_value(v + xyz_offset[1], xyz_type[1])),
+                                             real(read_ply_value(v + xyz_offset[2], xyz_type[2])));
+                }
+            });
+            p += element.count * stride;
+        } else if (element.name == "face" && list_index >= 0) {
+            // Sequential pass: find where each chunk of faces starts and how many indices it emits.
+            int chunks = num_threads * chunks_per_thread;
+            std::vector<const char*> chunk_start(size_t(chunks) + 1, nullptr);
+            std::vector<size_t> chunk_first_index(size_t(chunks) + 1, 0);
+            size_t index_count = 0;
+            const char* q = p;
+            for (size_t face = 0; face < element.count; face++) {
+                size_t chunk = face * size_t(chunks) / element.count;
+                if (chunk_start[chunk] == nullptr) {
+                    chunk_start[chunk] = q;
+                    chunk_first_index[chunk] = index_count;
+                }
+                if (size_t(end - q) < before_list + size_t(count_size)) {
+                    error = path + ": truncated face data";
+                    return false;
+                }
+                uint32_t n = read_ply_index(q + before_list, count_size);
+                q += before_list + size_t(count_size) + size_t(n) * size_t(item_size) + after_list;
+                if (q > end) {
+                    error = path + ": truncated face data";
+                    return false;
+                }
+                index_count += n >= 3 ? 3 * size_t(n - 2) : 0;
+            }
+            chunk_start[size_t(chunks)] = q;
+            chunk_first_index[size_t(chunks)] = index_count;
+            for (int c = chunks - 1; c >= 0; c--) {
+                if (chunk_start[size_t(c)] == nullptr) {      // Fewer faces than chunks
+                    chunk_start[size_t(c)] = chunk_start[size_t(c) + 1];
+                    chunk_first_index[size_t(c)] = chunk_first_index[size_t(c) + 1];
+                }
+            }
+
+            mesh.indices.resize(index_count);
+            pool.parallel_for(chunks, [&](int c, int) {
+                const char* f = chunk_start[size_t(c)];
+                const char* f_end = chunk_start[size_t(c) + 1];
+                uint32_t* out = mesh.indices.data() + chunk_first_index[size_t(c)];
+                while (f < f_end) {
+                    uint32_t n = read_ply_index(f + before_list, count_size);
+                    const char* items = f + before_list + count_size;
+                    for (uint32_t k = 1; k + 1 < n; k++) {
+                        *out++ = read_ply_index(items, item_size);
+                        *out++ = read_ply_index(items + size_t(k) * size_t(item_size), item_size);
+                        *out++ = read_ply_index(items + size_t(k + 1) * size_t(item_size), item_size);
+                    }
+                    f = items + size_t(n) * size_t(item_size) + after_list;
+                }
+            });
+            p = q;
+        } else {
+            if (list_index >= 0) {
+                error = path + ": unsupported list property in element " + element.name;
+                return false;
+            }
+            size_t stride = before_list;
+            if (element.count > remaining / std::max<size_t>(stride, 1)) {
+                error = path + ": truncated " + element.name + " data";
+                return false;
+            }
+            p += element.count * stride;
+        }
+    }
+
+    for (uint32_t index : mesh.indices) {
+        if (index >= mesh.positions.size()) {
+            error = path + ": face refers to a missing vertex";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Loads an OBJ or PLY file, told apart by the file name extension.
+inline bool load_mesh(const std::string& path, mesh_data& mesh, std::string& error,
+                      int num_threads = default_thread_count()) {
+    auto ends_with = [&](const char* suffix) {
+        size_t n = std::strlen(suffix);
+        if (path.size() < n)
+            return false;
+        for (size_t i = 0; i < n; i++) {
+            if (std::tolower(static_cast<unsigned char>(path[path.size() - n + i])) != suffix[i])
+                return false;
+        }
+        return true;
+    };
+    if (ends_with(".obj"))
+        return load_obj(path, mesh, error, num_threads);
+    if (ends_with(".ply"))
+        return load_ply(path, mesh, error, num_threads);
+    error = path + ": unknown mesh format (expected .obj or .ply)";
+    return false;
+}
+
+#endif //MESH_IO_H
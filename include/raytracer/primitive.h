@@ -0,0 +1,121 @@
+#ifndef PRIMITIVE_H
+#define PRIMITIVE_H
+
+#include "raytracer.h"
+#include "hittable.h"
+#include "sphere.h"
+
+#include <memory>
+#include <variant>
+#include <vector>
+
+using std::shared_ptr;
+
+
+// Closed set of concrete primitive types, stored by value. Dispatching on a variant is a jump
+// on its index, and every alternative is a final class, so each intersect() call is a direct call the
+// compiler can inline into the loop around it. Add new primitive types to this list.
+using primitive = std::variant<sphere>;
+
+
+// Uniform access to the objects a container or acceleration structure may hold: primitives by
+// value (static dispatch) or arbitrary hittables behind shared_ptr (virtual dispatch).
+inline bool intersect_object(const primitive& object, const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) {
+    return std::visit([&](const auto& prim){ return prim.intersect(r, ray_tmin, ray_tmax, hit); }, object);
+}
+
+inline void intersect_object_packet(const primitive& object, const ray_packet& packet, packet_hits& hits) {
+    std::visit([&](const auto& prim){ prim.intersect_packet(packet, hits); }, object);
+}
+
+inline bool occluded_object(const primitive& object, const ray& r, real ray_tmin, real ray_tmax) {
+    return std::visit([&](const auto& prim){ return prim.occluded(r, ray_tmin, ray_tmax); }, object);
+}
+
+inline void occluded_object_packet(const primitive& object, const ray_packet& packet, packet_occlusion& occlusion) {
+    std::visit([&](const auto& prim){ prim.occluded_packet(packet, occlusion); }, object);
+}
+
+inline aabb object_bounds(const primitive& object) {
+    return std::visit([](const auto& prim){ return prim.bounding_box(); }, object);
+}
+
+inline bool intersect_object(const shared_ptr<hittable>& object, const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) {
+    return object->intersect(r, ray_tmin, ray_tmax, hit);
+}
+
+inline void intersect_object_packet(const shared_ptr<hittable>& object, const ray_packet& packet, packet_hits& hits) {
+    object->intersect_packet(packet, hits);
+}
+
+inline bool occluded_object(const shared_ptr<hittable>& object, const ray& r, real ray_tmin, real ray_tmax) {
+    return object->occluded(r, ray_tmin, ray_tmax);
+}
+
+inline void occluded_object_packet(const shared_ptr<hittable>& object, const ray_packet& packet, packet_occlusion& occlusion) {
+    object->occluded_packet(packet, occlusion);
+}
+
+inline aabb object_bounds(const shared_ptr<hittable>& object) {
+    return object->bounding_box();
+}
+
+
+// Statically dispatched counterpart of hittable_list: primitives are held by value in one
+// contiguous array, without refcounting or a virtual call per object.
+class primitive_list : public hittable {
+public:
+    std::vector<primitive> objects;
+
+    void clear() {
+        objects.clear();
+        bbox = aabb();
+    }
+
+    void add(const primitive& object) {
+        bbox.expand(object_bounds(object));
+        objects.push_back(object);
+    }
+
+    bool intersect(const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) const override {
+        bool hit_anything = false;
+        auto closest_so_far = ray_tmax;
+
+        for (const auto& object : objects) {
+            if (intersect_object(object, r, ray_tmin, closest_so_far, hit)) {
+                hit_anything = true;
+                closest_so_far = hit.t;
+            }
+        }
+        return hit_anything;
+    }
+
+    void intersect_packet(const ray_packet& packet, packet_hits& hits) const override {
+        for (const auto& object : objects) {
+            intersect_object_packet(object, packet, hits);
+        }
+    }
+
+    bool occluded(const ray& r, real ray_tmin, real ray_tmax) const override {
+        for (const auto& object : objects) {
+            if (occluded_object(object, r, ray_tmin, ray_tmax))
+                return true;
+        }
+        return false;
+    }
+
+    void occluded_packet(const ray_packet& packet, packet_occlusion& occlusion) const override {
+        for (const auto& object : objects) {
+            occluded_object_packet(object, packet, occlusion);
+            if (occlusion.all_occluded())
+                return;
+        }
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    aabb bbox;
+};
+
+#endif //PRIMITIVE_H
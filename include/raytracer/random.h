@@ -0,0 +1,60 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include "raytracer.h"
+
+#include <cstdint>
+
+
+// Maps 32 random bits to [0, 1), keeping the 24 bits a float can hold so the result stays below 1.
+inline real unit_interval(uint32_t bits) {
+    return real(bits >> 8) * real(1.0 / 16777216.0);
+}
+
+// Uniformly distributed direction of unit length, from two uniform numbers in [0, 1).
+inline vec3 uniform_sphere(real u1, real u2) {
+    real z = 1 - 2 * u1;
+    real r = std::sqrt(std::max(real(0), 1 - z*z));
+    real phi = 2 * pi * u2;
+    return vec3(r * std::cos(phi), r * std::sin(phi), z);
+}
+
+// 32-bit integer hash (lowbias32 by Chris Wellons), for deriving seeds from indices.
+inline uint32_t hash32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352dU;
+    x ^= x >> 15;
+    x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+
+// PCG32 pseudo-random generator (O'Neill, pcg-random.org): 64 bits of state, a multiply and an
+// add per number, and 2^63 independent streams. A generator lives on the stack of the thread
+// using it, e.g. one per pixel sample with the pixel as its stream, so render threads share no
+// state and a frame renders the same whatever the thread count.
+class rng {
+public:
+    explicit rng(uint64_t seed, uint64_t stream = 0) : increment((stream << 1) | 1) {
+        next();
+        state += seed;
+        next();
+    }
+
+    uint32_t next() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + increment;
+        uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+        uint32_t rot = uint32_t(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+    // Uniform in [0, 1).
+    real uniform() { return unit_interval(next()); }
+
+private:
+    uint64_t state = 0;
+    uint64_t increment;
+};
+
+#endif //RANDOM_H
@@ -3,8 +3,6 @@
 
 #include "raytracer.h"
 
-using namespace glm;
-
 class ray {
 public:
     ray() {}
@@ -14,7 +12,7 @@ public:
     const vec3& origin() const  { return orig; }
     const vec3& direction() const { return dir; }
 
-    vec3 at(float t) const {
+    vec3 at(real t) const {
         return orig + t*dir;
     }
 
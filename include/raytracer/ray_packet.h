@@ -0,0 +1,113 @@
+#ifndef RAY_PACKET_H
+#define RAY_PACKET_H
+
+#include "raytracer.h"
+#include "aabb.h"
+#include "ray.h"
+#include "simd.h"
+
+
+// Square block of rays sharing one origin, e.g. the primary rays of an 8x8 pixel block.
+// Directions are stored structure-of-arrays so that kernels can test simd_width rays at once.
+// The four side planes of the frustum spanned by the corner rays let an acceleration structure
+// reject a box for the whole packet with four plane tests.
+class ray_packet {
+public:
+    static constexpr int width = 8;               // Packet covers width x width pixels
+    static constexpr int size  = width * width;   // Rays per packet, a multiple of simd_width
+
+    vec3  origin;
+    float tmin = 0.0f;
+    alignas(64) float dir_x[size], dir_y[size], dir_z[size];
+    alignas(64) float inv_x[size], inv_y[size], inv_z[size];
+
+    void set_direction(int i, const vec3& d) {
+        dir_x[i] = d.x;
+        dir_y[i] = d.y;
+        dir_z[i] = d.z;
+        inv_x[i] = 1.0f / d.x;
+        inv_y[i] = 1.0f / d.y;
+        inv_z[i] = 1.0f / d.z;
+    }
+
+    vec3 direction(int i) const { return vec3(dir_x[i], dir_y[i], dir_z[i]); }
+
+    ray get(int i) const { return ray(origin, direction(i)); }
+
+    // Sets the frustum from four directions, in winding order around the packet, that bound
+    // every ray of the packet (for a pinhole camera these are just the corner rays).
+    void set_frustum(const vec3& d0, const vec3& d1, const vec3& d2, const vec3& d3) {
+        vec3 corners[4] = {d0, d1, d2, d3};
+        vec3 center = d0 + d1 + d2 + d3;
+        for (int k = 0; k < 4; k++) {
+            vec3 n = cross(corners[k], corners[(k+1) % 4]);
+            real len = length(n);
+            // Coincident corners (a one pixel wide block) give no plane; a zero normal culls nothing.
+            n = len > real(1e-12) ? n / len : vec3(0, 0, 0);
+            planes[k] = dot(n, center) < 0.0f ? -n : n;
+        }
+    }
+
+    // The same rays seen through the affine map x -> m * (x - offset), e.g. in the object space of
+    // an instance. Distances along the rays are unchanged. plane_map, the inverse transpose of m,
+    // carries the frustum planes along.
+    ray_packet transformed(const mat3& m, const vec3& offset, const mat3& plane_map) const {
+        ray_packet out;
+        out.origin = m * (origin - offset);
+        out.tmin = tmin;
+        for (int i = 0; i < size; i++) {
+            out.set_direction(i, m * direction(i));
+        }
+        for (int k = 0; k < 4; k++) {
+            vec3 n = plane_map * planes[k];
+            real len = length(n);
+            out.planes[k] = len > real(1e-12) ? n / len : vec3(0, 0, 0);
+        }
+        return out;
+    }
+
+    // Inward-facing unit normal of side plane k (0..3); the plane passes through origin.
+    const vec3& frustum_plane(int k) const { return planes[k]; }
+
+    // False only if the box is certainly missed by every ray in the packet.
+    bool frustum_overlaps(const aabb& box) const {
+        for (const vec3& n : planes) {
+            // Box corner furthest along the plane normal.
+            vec3 p(n.x >= 0.0f ? box.max.x : box.min.x,
+                   n.y >= 0.0f ? box.max.y : box.min.y,
+                   n.z >= 0.0f ? box.max.z : box.min.z);
+            if (dot(n, p - origin) < 0.0f)
+                return false;
+        }
+        return true;
+    }
+
+    // Slab test of every ray against a box, counting only entries before each ray's current
+    // closest hit t_max[i]. Returns the smallest entry distance over all rays, INFINITY on a miss.
+    float hit_box(const aabb& box, const float* t_max) const {
+        vfloat min_x(box.min.x - origin.x), min_y(box.min.y - origin.y), min_z(box.min.z - origin.z);
+        vfloat max_x(box.max.x - origin.x), max_y(box.max.y - origin.y), max_z(box.max.z - origin.z);
+        vfloat nearest(INFINITY);
+        for (int i = 0; i < size; i += simd_width) {
+            vfloat ix = vfloat::load(&inv_x[i]), iy = vfloat::load(&inv_y[i]), iz = vfloat::load(&inv_z[i]);
+            vfloat tx0 = min_x * ix, tx1 = max_x * ix;
+            vfloat ty0 = min_y * iy, ty1 = max_y * iy;
+            vfloat tz0 = min_z * iz, tz1 = max_z * iz;
+            vfloat t_enter = vmax(vmax(vmin(tx0, tx1), vmin(ty0, ty1)), vmax(vmin(tz0, tz1), vfloat(tmin)));
+            vfloat t_exit  = vmin(vmin(vmax(tx0, tx1), vmax(ty0, ty1)), vmin(vmax(tz0, tz1), vfloat::load(&t_max[i])));
+            nearest = select(t_enter <= t_exit, vmin(nearest, t_enter), nearest);
+        }
+        float lanes[simd_width];
+        nearest.store(lanes);
+        float t = INFINITY;
+        for (float lane : lanes) {
+            t = lane < t ? lane : t;
+        }
+        return t;
+    }
+
+private:
+    vec3 planes[4];  // Inward-facing side planes through origin
+};
+
+#endif //RAY_PACKET_H
@@ -9,28 +9,62 @@
 #include <limits>
 #include <memory>
 
+// Scalar type of the geometry pipeline (rays, hit records, primitives, bounding boxes). Float by
+// default, so every intersection stays in single precision and matches the SIMD kernels; build
+// with RAYTRACER_DOUBLE_PRECISION for double-precision reference renders. The packet and SoA
+// kernels (ray_packet, sphere_set) always run in float.
+#ifdef RAYTRACER_DOUBLE_PRECISION
+using real = double;
+#else
+using real = float;
+#endif
+
+using vec2 = glm::vec<2, real>;
+using vec3 = glm::vec<3, real>;
+using mat3 = glm::mat<3, 3, real>;
+
+// Constants
+
+const real infinity = std::numeric_limits<real>::infinity();
+const real pi = real(3.1415926535897932385);
+
+// Utility Functions
+
+inline real degrees_to_radians(real degrees) {
+    return degrees * pi / 180;
+}
+
+#include "aabb.h"
+#include "async_renderer.h"
+#include "bvh.h"
 #include "camera.h"
 #include "color.h"
+#include "dynamic_scene.h"
+#include "frame_profiler.h"
 #include "hittable.h"
 #include "hittable_list.h"
+#include "instance.h"
+#include "material.h"
+#include "mesh_io.h"
+#include "primitive.h"
+#include "random.h"
 #include "ray.h"
+#include "ray_packet.h"
+#include "reprojection_cache.h"
+#include "resolution_controller.h"
+#include "sampler.h"
+#include "scene.h"
+#include "scene_cache.h"
+#include "screen_bins.h"
 #include "sphere.h"
+#include "sphere_set.h"
+#include "tiled_framebuffer.h"
+#include "triangle_mesh.h"
+#include "triple_buffer.h"
 
 // C++ Std Usings
 
 using std::make_shared;
 using std::shared_ptr;
-using namespace glm;
-
-// Constants
-
-const double infinity = std::numeric_limits<double>::infinity();
-const double pi = 3.1415926535897932385;
-
-// Utility Functions
-
-float degrees_to_radians(float degrees) {
-    return degrees * pi / 180.0f;
-}
 
 #endif //RAYTRACER_H
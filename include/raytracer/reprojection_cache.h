@@ -0,0 +1,117 @@
+#ifndef REPROJECTION_CACHE_H
+#define REPROJECTION_CACHE_H
+
+#include "raytracer.h"
+#include "color.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+
+// Per-pixel results of the previous frame, reused by the next one when the camera moves only a
+// little. Every pixel keeps its color and its hit point, or for background its ray direction
+// (a point at infinity); reproject() scatters those points to where the new camera sees them
+// (nearest point wins), and lookup() hands them back to the pixels they landed on. Pixels that
+// nothing landed on (disocclusions, the screen border) must be traced again, and so must pixels
+// next to a depth discontinuity: silhouettes move by fractions of a pixel, and background or a
+// far surface may show through a gap in a surface the camera approached.
+class reprojection_cache {
+public:
+    struct sample {
+        vec3  position = vec3(0, 0, 0);   // Hit point of the pixel's first sample, or its direction on a miss
+        color sum = color(0, 0, 0);       // Sum of the pixel's samples in that frame
+        bool  hit = false;
+    };
+
+    // Sizes the cache for the coming frame; history of another size or sample count is dropped.
+    void resize(int width, int height, int samples_per_pixel) {
+        if (width != cache_width || height != cache_height || samples_per_pixel != cache_samples) {
+            invalidate();
+            cache_width = width;
+            cache_height = height;
+            cache_samples = samples_per_pixel;
+        }
+        size_t pixels = size_t(width) * height;
+        previous.resize(pixels);
+        current.resize(pixels);
+        landed.resize(pixels);
+    }
+
+    void invalidate() { valid = false; }
+
+    bool has_history() const { return valid; }
+
+    // Scatters the previous frame's samples into the current frame. `project` maps a sample to a
+    // pixel index and its view depth (INFINITY for background), returning false if it is off screen.
+    template<typename Project>
+    void reproject(thread_pool& pool, const Project& project) {
+        std::fill(landed.begin(), landed.end(), empty);
+        if (!valid)
+            return;
+        pool.parallel_for(cache_height, [&](int row, int){
+            for (int i = row * cache_width; i < (row + 1) * cache_width; i++) {
+                int pixel;
+                float depth;
+                if (!project(previous[i], pixel, depth))
+                    continue;
+                // Depth in the high half, so the smallest key is the nearest point; positive
+                // floats order like their bit patterns.
+                uint64_t key = (uint64_t(std::bit_cast<uint32_t>(depth)) << 32) | uint32_t(i);
+                std::atomic_ref<uint64_t> slot(landed[pixel]);
+                uint64_t seen = slot.load(std::memory_order_relaxed);
+                while (key < seen && !slot.compare_exchange_weak(seen, key, std::memory_order_relaxed)) {}
+            }
+        });
+    }
+
+    // The previous-frame sample reprojected onto pixel, if there is one that can be trusted.
+    bool lookup(int pixel, sample& out) const {
+        if (landed[pixel] == empty)
+            return false;
+        int i = pixel % cache_width, j = pixel / cache_width;
+        float depth = landed_depth(pixel);
+        if ((i > 0 && !continuous(depth, pixel - 1)) ||
+            (i + 1 < cache_width && !continuous(depth, pixel + 1)) ||
+            (j > 0 && !continuous(depth, pixel - cache_width)) ||
+            (j + 1 < cache_height && !continuous(depth, pixel + cache_width)))
+            return false;
+        out = previous[uint32_t(landed[pixel])];
+        return true;
+    }
+
+    // Records this frame's result for pixel, to be reprojected by the next frame.
+    void store(int pixel, const sample& s) { current[pixel] = s; }
+
+    // Makes this frame's samples the history of the next one.
+    void end_frame() {
+        std::swap(previous, current);
+        valid = true;
+    }
+
+private:
+    static constexpr uint64_t empty = ~uint64_t(0);
+    static constexpr float depth_tolerance = 0.05f;  // Relative depth step still treated as one surface
+
+    float landed_depth(int pixel) const { return std::bit_cast<float>(uint32_t(landed[pixel] >> 32)); }
+
+    // Whether the sample that landed on neighbor continues the surface at the given depth.
+    bool continuous(float depth, int neighbor) const {
+        if (landed[neighbor] == empty)
+            return false;
+        float other = landed_depth(neighbor);
+        if (depth == INFINITY || other == INFINITY)
+            return depth == other;
+        return std::abs(depth - other) <= depth_tolerance * std::min(depth, other);
+    }
+
+    std::vector<sample> previous, current;
+    std::vector<uint64_t> landed;   // Per pixel: depth and index of the nearest reprojected sample
+    int cache_width = 0, cache_height = 0, cache_samples = 0;
+    bool valid = false;
+};
+
+#endif //REPROJECTION_CACHE_H
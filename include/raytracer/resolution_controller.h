@@ -0,0 +1,60 @@
+#ifndef RESOLUTION_CONTROLLER_H
+#define RESOLUTION_CONTROLLER_H
+
+#include <algorithm>
+#include <cmath>
+
+
+// Picks the render resolution that keeps the trace time near a target. Trace time is modeled as
+// proportional to the pixels traced: each measured frame updates a smoothed cost per pixel, from
+// which the controller derives the pixel budget of the target time and hence a scale relative to
+// the output (window) resolution. Small corrections are ignored, so the resolution only changes
+// when the load really does; this keeps progressive accumulation and reprojection history intact.
+class resolution_controller {
+public:
+    double target_ms = 16.7;     // Trace time to aim for
+    float min_scale = 0.25f;     // Bounds of the render/output resolution ratio, per axis
+    float max_scale = 1.0f;
+    double smoothing = 0.3;      // Weight of the newest frame in the cost per pixel
+    float deadband = 0.08f;      // Relative scale change below which the scale is kept
+
+    float scale() const { return std::clamp(current, min_scale, max_scale); }
+
+    // Render size for an output of the given size, a multiple of 8 per axis (the ray packet width)
+    // where the output is large enough.
+    void render_size(int output_width, int output_height, int& width, int& height) const {
+        width = std::max(1, round_to_block(output_width * scale()));
+        height = std::max(1, round_to_block(output_height * scale()));
+    }
+
+    // Feeds the trace time of a frame that traced traced_pixels pixels, shown at an output of
+    // output_width x output_height, and updates the scale. Pass only the pixels actually traced:
+    // with temporal reprojection most of a frame is reused, and counting those pixels would make
+    // tracing look cheap, raise the resolution and so drop the history the frames relied on.
+    void update(double trace_ms, long long traced_pixels, int output_width, int output_height) {
+        double pixels = double(traced_pixels);
+        if (trace_ms <= 0.0 || pixels <= 0.0)
+            return;
+        double cost = trace_ms / pixels;
+        cost_per_pixel = cost_per_pixel > 0.0 ? smoothing * cost + (1.0 - smoothing) * cost_per_pixel : cost;
+
+        double budget = target_ms / cost_per_pixel;
+        float wanted = float(std::sqrt(budget / (double(output_width) * output_height)));
+        wanted = std::clamp(wanted, min_scale, max_scale);
+        float now = scale();
+        bool at_bound = wanted != now && (wanted == min_scale || wanted == max_scale);
+        if (at_bound || std::abs(wanted - now) > deadband * now)
+            current = wanted;
+    }
+
+private:
+    float current = 1.0f;
+    double cost_per_pixel = 0.0;   // Smoothed trace milliseconds per pixel
+
+    static int round_to_block(float size) {
+        int s = int(size + 0.5f);
+        return s >= 16 ? s / 8 * 8 : s;
+    }
+};
+
+#endif //RESOLUTION_CONTROLLER_H
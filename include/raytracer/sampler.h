@@ -0,0 +1,125 @@
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "raytracer.h"
+#include "random.h"
+
+#include <array>
+#include <cstdint>
+
+
+// Direction numbers of the first four Sobol dimensions (Joe and Kuo), as 32-bit fractions.
+constexpr std::array<std::array<uint32_t, 32>, 4> sobol_directions() {
+    std::array<std::array<uint32_t, 32>, 4> v{};
+    for (int i = 0; i < 32; i++)
+        v[0][i] = 1U << (31 - i);
+    // Degree s, polynomial coefficients a and initial numbers m of dimensions 1 to 3.
+    constexpr uint32_t s[3] = {1, 2, 3};
+    constexpr uint32_t a[3] = {0, 1, 1};
+    constexpr uint32_t m[3][3] = {{1, 0, 0}, {1, 3, 0}, {1, 3, 1}};
+    for (int d = 1; d < 4; d++) {
+        uint32_t deg = s[d-1];
+        for (uint32_t i = 0; i < 32; i++) {
+            if (i < deg) {
+                v[d][i] = m[d-1][i] << (31 - i);
+                continue;
+            }
+            v[d][i] = v[d][i-deg] ^ (v[d][i-deg] >> deg);
+            for (uint32_t k = 1; k < deg; k++) {
+                if ((a[d-1] >> (deg - 1 - k)) & 1)
+                    v[d][i] ^= v[d][i-k];
+            }
+        }
+    }
+    return v;
+}
+
+inline constexpr std::array<std::array<uint32_t, 32>, 4> sobol_direction_numbers = sobol_directions();
+
+
+// Numbers for one sample of one pixel, drawn dimension after dimension: a path asks for as many
+// as its bounces need (scatter directions, Russian roulette, Fresnel choices).
+//
+// sequence::sobol draws from an Owen-scrambled Sobol sequence, following Burley, "Practical
+// Hash-based Owen Scrambling" (JCGT 2020). The sample index is shuffled and every dimension
+// scrambled with seeds hashed from the pixel, so each pixel sees its own decorrelated copy of the
+// sequence, yet any power-of-two count of consecutive samples still stratifies every 4D group of
+// dimensions. Dimensions past the first four are padded with independently seeded 4D groups.
+// Low-discrepancy samples like these converge in noticeably fewer samples than random ones.
+// sequence::random draws from a PCG32 stream per pixel instead, as an unbiased reference.
+//
+// A sampler is constructed on the stack of the thread tracing the sample, from the pixel and
+// sample index alone, so results don't depend on which thread traced what.
+class sampler {
+public:
+    enum class sequence { random, sobol };
+
+    sampler(sequence seq, uint32_t pixel, uint32_t index)
+        : seq(seq), pixel_seed(hash32(pixel)), index(index), gen(index, pixel) {}
+
+    // Next dimension, uniform in [0, 1).
+    real uniform() {
+        if (seq == sequence::random)
+            return gen.uniform();
+        uint32_t group_seed = hash32(pixel_seed ^ hash32(dimension / 4));
+        uint32_t d = dimension % 4;
+        ++dimension;
+        uint32_t shuffled = nested_uniform_scramble(index, group_seed);
+        return unit_interval(nested_uniform_scramble(sobol(shuffled, d), hash32(group_seed + d + 1)));
+    }
+
+    // Next two dimensions, kept within one 4D group so the pair is stratified jointly.
+    vec2 uniform_2d() {
+        if (dimension % 4 == 3)
+            ++dimension;
+        real u = uniform();
+        return vec2(u, uniform());
+    }
+
+    // Uniformly distributed direction of unit length.
+    vec3 unit_vector() {
+        vec2 u = uniform_2d();
+        return uniform_sphere(u.x, u.y);
+    }
+
+private:
+    sequence seq;
+    uint32_t pixel_seed;
+    uint32_t index;
+    uint32_t dimension = 0;
+    rng gen;
+
+    static uint32_t sobol(uint32_t i, uint32_t d) {
+        uint32_t x = 0;
+        for (int bit = 0; i != 0; i >>= 1, bit++) {
+            if (i & 1)
+                x ^= sobol_direction_numbers[d][bit];
+        }
+        return x;
+    }
+
+    static uint32_t reverse_bits(uint32_t x) {
+        x = ((x >> 1) & 0x55555555U) | ((x & 0x55555555U) << 1);
+        x = ((x >> 2) & 0x33333333U) | ((x & 0x33333333U) << 2);
+        x = ((x >> 4) & 0x0F0F0F0FU) | ((x & 0x0F0F0F0FU) << 4);
+        x = ((x >> 8) & 0x00FF00FFU) | ((x & 0x00FF00FFU) << 8);
+        return (x >> 16) | (x << 16);
+    }
+
+    // Hash that only propagates bits upwards (Laine and Karras), i.e. an Owen scramble when
+    // applied to bit-reversed values.
+    static uint32_t laine_karras_permutation(uint32_t x, uint32_t seed) {
+        x += seed;
+        x ^= x * 0x6c50b47cU;
+        x ^= x * 0xb82f1e52U;
+        x ^= x * 0xc7afe638U;
+        x ^= x * 0x8d22f6e6U;
+        return x;
+    }
+
+    static uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+        return reverse_bits(laine_karras_permutation(reverse_bits(x), seed));
+    }
+};
+
+#endif //SAMPLER_H
@@ -0,0 +1,254 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include "raytracer.h"
+#include "bvh.h"
+#include "hittable_list.h"
+#include "instance.h"
+#include "material.h"
+#include "mesh_io.h"
+#include "primitive.h"
+#include "sphere.h"
+#include "sphere_set.h"
+#include "triangle_mesh.h"
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+// Camera placement stored with a scene, in the terms of the camera's members of the same names.
+// The default looks down -z from the origin.
+struct scene_view {
+    vec3   lookfrom = vec3(0, 0, 0);
+    float  yaw      = 90.0f;
+    float  pitch    = 0.0f;
+    double vfov     = 90.0;
+};
+
+
+// Everything a frame traces: spheres in a static_bvh, triangle meshes that each carry their own
+// BVH, and instances of shared geometry under an instance_bvh. Filled by load_scene() from a scene
+// file or by load_scene_cache() (scene_cache.h) from its compiled form; world() is what goes to
+// camera::render, with few enough spheres traced from a flat sphere_set instead of the tree.
+class scene {
+public:
+    scene_view view;
+    shared_ptr<static_bvh> primitives;
+    std::vector<shared_ptr<triangle_mesh>> meshes;
+    std::vector<shared_ptr<triangle_mesh>> geometries;  // Only placed through instances
+    shared_ptr<instance_bvh> instances;
+
+    // Scenes with up to this many spheres trace them from one flat sphere_set instead of the
+    // static_bvh. Below a few hundred spheres the SIMD scan beats the tree on whole frames (see
+    // also the sphere_set_hit and bvh_hit benchmarks). sphere_set traces in float, so
+    // double-precision builds always use the tree.
+#ifdef RAYTRACER_DOUBLE_PRECISION
+    static constexpr size_t max_flat_spheres = 0;
+#else
+    static constexpr size_t max_flat_spheres = 256;
+#endif
+
+    const hittable& world() const { return root; }
+
+    // Collects primitives, meshes and instances into world(); call after changing any of them.
+    void update_world() {
+        root.clear();
+        if (primitives) {
+            if (auto flat = flatten(*primitives))
+                root.add(flat);
+            else
+                root.add(primitives);
+        }
+        for (const auto& mesh : meshes) {
+            root.add(mesh);
+        }
+        if (instances)
+            root.add(instances);
+    }
+
+private:
+    hittable_list root;
+
+    // The spheres of tree as a sphere_set, or null when there are too many or other primitives.
+    static shared_ptr<sphere_set> flatten(const static_bvh& tree) {
+        const std::vector<primitive>& objects = tree.object_array();
+        if (objects.empty() || objects.size() > max_flat_spheres)
+            return nullptr;
+        auto set = make_shared<sphere_set>();
+        for (const primitive& object : objects) {
+            const sphere* s = std::get_if<sphere>(&object);
+            if (!s)
+                return nullptr;
+            set->add(s->get_center(), float(s->get_radius()), s->get_material());
+        }
+        return set;
+    }
+};
+
+
+// Reads a scene file: plain text, one statement per line, '#' starts a comment.
+//
+//     camera <x> <y> <z> <yaw> <pitch> <vfov>
+//     material <name> diffuse <r> <g> <b>
+//     material <name> metal <r> <g> <b> <fuzz>
+//     material <name> dielectric <index of refraction>
+//     material <name> emissive <r> <g> <b>
+//     sphere <x> <y> <z> <radius> <material>
+//     mesh <path> <material> [scale <s>] [translate <x> <y> <z>]
+//     geometry <name> <path> <material>
+//     instance <geometry> [scale <s>] [rotate <x> <y> <z> <degrees>] [translate <x> <y> <z>] ...
+//
+// Materials must be defined before use. Mesh paths are relative to the scene file; meshes are
+// OBJ or binary PLY (see mesh_io.h), scaled and then translated into place. A geometry is a mesh
+// that is loaded once and only appears where instances place it; an instance's transforms apply
+// in the order written.
+// Returns false and sets error, naming the line, on anything it doesn't understand.
+inline bool load_scene(const std::string& path, scene& out, std::string& error,
+                       int num_threads = default_thread_count()) {
+    std::ifstream in(path);
+    if (!in) {
+        error = "cannot read " + path;
+        return false;
+    }
+    std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+
+    std::map<std::string, material> materials;
+    std::map<std::string, shared_ptr<triangle_mesh>> named_geometries;
+    primitive_list primitives;
+    std::vector<shared_ptr<triangle_mesh>> meshes, geometries;
+    std::vector<instance> instances;
+    scene_view view;
+
+    std::string line;
+    for (int line_number = 1; std::getline(in, line); line_number++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream words(line);
+        std::string keyword;
+        if (!(words >> keyword))
+            continue;
+        auto fail = [&](const std::string& message) {
+            error = path + ":" + std::to_string(line_number) + ": " + message;
+            return false;
+        };
+        auto find_material = [&](const std::string& name, const material*& mat) {
+            auto it = materials.find(name);
+            mat = it != materials.end() ? &it->second : nullptr;
+            return mat != nullptr;
+        };
+
+        if (keyword == "camera") {
+            real x, y, z;
+            if (!(words >> x >> y >> z >> view.yaw >> view.pitch >> view.vfov))
+                return fail("expected camera <x> <y> <z> <yaw> <pitch> <vfov>");
+            view.lookfrom = vec3(x, y, z);
+        } else if (keyword == "material") {
+            std::string name, type;
+            real r = 0, g = 0, b = 0, parameter = 0;
+            if (!(words >> name >> type))
+                return fail("expected material <name> <type> ...");
+            if (type == "diffuse" && words >> r >> g >> b) {
+                materials.insert_or_assign(name, material::diffuse(color(r, g, b)));
+            } else if (type == "metal" && words >> r >> g >> b >> parameter) {
+                materials.insert_or_assign(name, material::metal(color(r, g, b), parameter));
+            } else if (type == "dielectric" && words >> parameter) {
+                materials.insert_or_assign(name, material::dielectric(parameter));
+            } else if (type == "emissive" && words >> r >> g >> b) {
+                materials.insert_or_assign(name, material::emissive(color(r, g, b)));
+            } else {
+                return fail("bad material '" + name + "'");
+            }
+        } else if (keyword == "sphere") {
+            real x, y, z, radius;
+            std::string name;
+            const material* mat;
+            if (!(words >> x >> y >> z >> radius >> name))
+                return fail("expected sphere <x> <y> <z> <radius> <material>");
+            if (!find_material(name, mat))
+                return fail("unknown material '" + name + "'");
+            primitives.add(sphere(vec3(x, y, z), radius, *mat));
+        } else if (keyword == "mesh") {
+            std::string file, name, option;
+            const material* mat;
+            real scale = 1;
+            vec3 offset(0, 0, 0);
+            if (!(words >> file >> name))
+                return fail("expected mesh <path> <material>");
+            if (!find_material(name, mat))
+                return fail("unknown material '" + name + "'");
+            while (words >> option) {
+                if (option == "scale" && words >> scale)
+                    continue;
+                if (option == "translate" && words >> offset.x >> offset.y >> offset.z)
+                    continue;
+                return fail("bad mesh option '" + option + "'");
+            }
+            if (!file.empty() && file[0] != '/')
+                file = directory + file;
+            mesh_data data;
+            if (!load_mesh(file, data, error, num_threads))
+                return fail(error);
+            for (vec3& p : data.positions) {
+                p = p * scale + offset;
+            }
+            meshes.push_back(make_shared<triangle_mesh>(std::move(data.positions), std::move(data.indices), *mat));
+        } else if (keyword == "geometry") {
+            std::string name, file, material_name;
+            const material* mat;
+            if (!(words >> name >> file >> material_name))
+                return fail("expected geometry <name> <path> <material>");
+            if (!find_material(material_name, mat))
+                return fail("unknown material '" + material_name + "'");
+            if (!file.empty() && file[0] != '/')
+                file = directory + file;
+            mesh_data data;
+            if (!load_mesh(file, data, error, num_threads))
+                return fail(error);
+            geometries.push_back(make_shared<triangle_mesh>(std::move(data.positions), std::move(data.indices), *mat));
+            named_geometries.insert_or_assign(name, geometries.back());
+        } else if (keyword == "instance") {
+            std::string name, option;
+            if (!(words >> name))
+                return fail("expected instance <geometry> ...");
+            auto it = named_geometries.find(name);
+            if (it == named_geometries.end())
+                return fail("unknown geometry '" + name + "'");
+            mat3 linear(1);
+            vec3 offset(0, 0, 0);
+            while (words >> option) {
+                real s, degrees;
+                vec3 v;
+                if (option == "scale" && words >> s && s != 0 && std::isfinite(s)) {
+                    linear = mat3(s) * linear;
+                    offset = s * offset;
+                } else if (option == "rotate" && words >> v.x >> v.y >> v.z >> degrees && dot(v, v) > 0) {
+                    linear = rotation(v, degrees) * linear;
+                    offset = rotation(v, degrees) * offset;
+                } else if (option == "translate" && words >> v.x >> v.y >> v.z) {
+                    offset += v;
+                } else {
+                    return fail("bad instance option '" + option + "'");
+                }
+            }
+            // Instances are hit through the inverse transform; a singular one has none.
+            real det = glm::determinant(linear);
+            if (det == 0 || !std::isfinite(det) || !std::isfinite(dot(offset, offset)))
+                return fail("singular instance transform");
+            instances.emplace_back(it->second, linear, offset);
+        } else {
+            return fail("unknown statement '" + keyword + "'");
+        }
+    }
+
+    out.view = view;
+    out.primitives = make_shared<static_bvh>(primitives);
+    out.meshes = std::move(meshes);
+    out.geometries = std::move(geometries);
+    out.instances = instances.empty() ? nullptr : make_shared<instance_bvh>(std::move(instances));
+    out.update_world();
+    return true;
+}
+
+#endif //SCENE_H
@@ -0,0 +1,401 @@
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include "raytracer.h"
+#include "bvh.h"
+#include "instance.h"
+#include "material.h"
+#include "mesh_io.h"
+#include "primitive.h"
+#include "scene.h"
+#include "sphere.h"
+#include "triangle_mesh.h"
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+
+// Compiled form of a scene: its primitives together with their finished BVHs, written by
+// write_scene_cache() and read back by load_scene_cache() with no parsing and no BVH build.
+//
+// The file is a header followed by flat arrays. The header locates each array by byte offset and
+// element count, and nodes and meshes refer to other elements by index, so the file holds no
+// pointers and can be mapped at any address. Arrays start on 64-byte boundaries, the alignment of
+// triangle_pack. Records are stored in the in-memory layout of this build, so a cache only loads
+// into a build with the same real type and SIMD width; the header records both, plus the record
+// sizes, and any other cache is rejected. Recompile the scene file in that case.
+namespace scene_cache_detail {
+    constexpr char     magic[8] = {'R', 'T', 'S', 'C', 'E', 'N', 'E', '1'};
+    constexpr uint32_t version = 2;
+    constexpr size_t   alignment = 64;
+
+    using sphere_node = static_bvh::bvh_node;
+    using pack_node = basic_bvh<triangle_pack>::bvh_node;
+    using instance_node = instance_bvh::bvh_node;
+
+    struct sphere_record {
+        vec3     center;
+        real     radius;
+        material mat = material::diffuse(color(0, 0, 0));
+    };
+
+    // One triangle_mesh: runs of the shared positions, indices, packs and nodes arrays. Meshes of
+    // scene::meshes come first, then those of scene::geometries.
+    struct mesh_record {
+        material mat = material::diffuse(color(0, 0, 0));
+        uint64_t first_position, position_count;
+        uint64_t first_index, index_count;
+        uint64_t first_pack, pack_count;
+        uint64_t first_node, node_count;
+    };
+
+    struct instance_record {
+        uint64_t geometry;      // Index into scene::geometries
+        mat3     linear;
+        vec3     offset;
+    };
+
+    struct section {
+        uint64_t offset;     // Bytes from the start of the file
+        uint64_t count;      // Elements
+    };
+
+    enum section_id { spheres, sphere_nodes, meshes, positions, indices, packs, pack_nodes, instances, instance_nodes,
+                      section_count };
+
+    struct header {
+        char     magic[8];
+        uint32_t version;
+        uint32_t real_size;
+        uint32_t simd_width;
+        uint32_t record_sizes[section_count];
+        real     lookfrom[3];
+        float    yaw, pitch;
+        double   vfov;
+        uint64_t world_mesh_count;          // Leading mesh records that belong to scene::meshes
+        section  sections[section_count];
+    };
+
+    inline uint32_t record_size(int id) {
+        constexpr uint32_t sizes[section_count] = {
+            sizeof(sphere_record), sizeof(sphere_node), sizeof(mesh_record), sizeof(vec3),
+            sizeof(uint32_t), sizeof(triangle_pack), sizeof(pack_node), sizeof(instance_record), sizeof(instance_node)};
+        return sizes[id];
+    }
+
+    static_assert(std::is_trivially_copyable_v<sphere_record> && std::is_trivially_copyable_v<mesh_record> &&
+                  std::is_trivially_copyable_v<sphere_node> && std::is_trivially_copyable_v<pack_node> &&
+                  std::is_trivially_copyable_v<triangle_pack> && std::is_trivially_copyable_v<vec3> &&
+                  std::is_trivially_copyable_v<instance_record> && std::is_trivially_copyable_v<instance_node>,
+                  "scene cache records are copied as raw bytes");
+
+    // Walks a tree from the root and checks that every node refers to objects inside their array
+    // and to children that come after it (as basic_bvh builds them), that no node is reached twice,
+    // and that no leaf lies deeper than the fixed traversal stacks of basic_bvh can hold. Traversal
+    // of a tree that passes thus can't leave the arrays, loop or overflow its stack.
+    template <typename Tree, typename Node>
+    bool valid_tree(const std::vector<Node>& nodes, uint64_t object_count) {
+        if (nodes.empty())
+            return true;
+        std::vector<bool> reached(nodes.size(), false);
+        std::vector<std::pair<uint32_t, int>> stack = {{0, 0}};    // Node, depth below the root
+        while (!stack.empty()) {
+            auto [i, depth] = stack.back();
+            stack.pop_back();
+            if (reached[i] || depth >= Tree::traversal_stack_size)
+                return false;
+            reached[i] = true;
+            const Node& node = nodes[i];
+            if (node.is_leaf()) {
+                if (uint64_t(node.first) + node.count > object_count)
+                    return false;
+            } else {
+                if (node.first <= i || uint64_t(node.first) + 1 >= nodes.size())
+                    return false;
+                stack.push_back({node.first, depth + 1});
+                stack.push_back({node.first + 1, depth + 1});
+            }
+        }
+        return true;
+    }
+
+    // Checks that every lane of a pack holds a triangle of its mesh, whose indices surface() looks
+    // up, or is padding: no triangle and NaN vertices, which no ray hits.
+    inline bool valid_pack(const triangle_pack& pack, uint64_t triangle_count) {
+        for (int lane = 0; lane < simd_width; lane++) {
+            if (pack.triangle[lane] < triangle_count)
+                continue;
+            if (pack.triangle[lane] != UINT32_MAX)
+                return false;
+            for (int axis = 0; axis < 3; axis++) {
+                if (!std::isnan(pack.v0[axis][lane]) || !std::isnan(pack.v1[axis][lane]) || !std::isnan(pack.v2[axis][lane]))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Copies elements [first, first + count) of an array out of the mapped file.
+    template <typename T>
+    std::vector<T> read_array(const mapped_file& file, const section& s, uint64_t first = 0, uint64_t count = UINT64_MAX) {
+        if (count == UINT64_MAX)
+            count = s.count;
+        std::vector<T> out(count);
+        if (count > 0)
+            std::memcpy(static_cast<void*>(out.data()), file.data() + s.offset + first * sizeof(T), count * sizeof(T));
+        return out;
+    }
+}
+
+
+// Compiles a loaded scene into a cache file at path. Fails if the scene holds primitives the
+// cache can't represent (currently anything but spheres), instances of geometry outside
+// scene::geometries, or if the file can't be written.
+inline bool write_scene_cache(const std::string& path, const scene& in, std::string& error) {
+    using namespace scene_cache_detail;
+
+    std::vector<sphere_record> sphere_records;
+    std::vector<sphere_node> sphere_nodes_out;
+    if (in.primitives) {
+        for (const primitive& object : in.primitives->object_array()) {
+            const sphere* s = std::get_if<sphere>(&object);
+            if (s == nullptr) {
+                error = "scene cache: unsupported primitive type";
+                return false;
+            }
+            sphere_records.push_back(sphere_record{s->get_center(), s->get_radius(), s->get_material()});
+        }
+        sphere_nodes_out = in.primitives->node_array();
+    }
+
+    header h{};
+    std::memcpy(h.magic, magic, sizeof(magic));
+    h.version = version;
+    h.real_size = sizeof(real);
+    h.simd_width = simd_width;
+    for (int id = 0; id < section_count; id++) {
+        h.record_sizes[id] = record_size(id);
+    }
+    for (int axis = 0; axis < 3; axis++) {
+        h.lookfrom[axis] = in.view.lookfrom[axis];
+    }
+    h.yaw = in.view.yaw;
+    h.pitch = in.view.pitch;
+    h.vfov = in.view.vfov;
+
+    std::vector<shared_ptr<triangle_mesh>> all_meshes = in.meshes;
+    all_meshes.insert(all_meshes.end(), in.geometries.begin(), in.geometries.end());
+    h.world_mesh_count = in.meshes.size();
+
+    std::map<const hittable*, uint64_t> geometry_index;
+    for (size_t i = 0; i < in.geometries.size(); i++) {
+        geometry_index[in.geometries[i].get()] = i;
+    }
+    std::vector<instance_record> instance_records;
+    std::vector<instance_node> instance_nodes_out;
+    if (in.instances) {
+        for (const instance& object : in.instances->object_array()) {
+            auto it = geometry_index.find(object.geometry().get());
+            if (it == geometry_index.end()) {
+                error = "scene cache: instanced geometry is not in the scene's geometries";
+                return false;
+            }
+            instance_records.push_back(instance_record{it->second, object.linear(), object.offset()});
+        }
+        instance_nodes_out = in.instances->node_array();
+    }
+
+    std::vector<mesh_record> mesh_records;
+    mesh_record next{};
+    for (const auto& mesh : all_meshes) {
+        next.mat = mesh->get_material();
+        next.first_position += next.position_count;
+        next.position_count = mesh->vertex_positions().size();
+        next.first_index += next.index_count;
+        next.index_count = mesh->vertex_indices().size();
+        next.first_pack += next.pack_count;
+        next.pack_count = mesh->bvh().object_array().size();
+        next.first_node += next.node_count;
+        next.node_count = mesh->bvh().node_array().size();
+        mesh_records.push_back(next);
+    }
+
+    h.sections[spheres].count = sphere_records.size();
+    h.sections[sphere_nodes].count = sphere_nodes_out.size();
+    h.sections[meshes].count = mesh_records.size();
+    h.sections[positions].count = next.first_position + next.position_count;
+    h.sections[indices].count = next.first_index + next.index_count;
+    h.sections[packs].count = next.first_pack + next.pack_count;
+    h.sections[pack_nodes].count = next.first_node + next.node_count;
+    h.sections[instances].count = instance_records.size();
+    h.sections[instance_nodes].count = instance_nodes_out.size();
+    uint64_t offset = sizeof(header);
+    for (int id = 0; id < section_count; id++) {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        h.sections[id].offset = offset;
+        offset += h.sections[id].count * record_size(id);
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        error = "cannot write " + path;
+        return false;
+    }
+    auto write_at = [&](int id, const void* data, size_t bytes) {
+        static const char zeros[alignment] = {};
+        out.write(zeros, std::streamsize(h.sections[id].offset - uint64_t(out.tellp())));
+        out.write(static_cast<const char*>(data), std::streamsize(bytes));
+    };
+    out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    write_at(spheres, sphere_records.data(), sphere_records.size() * sizeof(sphere_record));
+    write_at(sphere_nodes, sphere_nodes_out.data(), sphere_nodes_out.size() * sizeof(sphere_node));
+    write_at(meshes, mesh_records.data(), mesh_records.size() * sizeof(mesh_record));
+    write_at(positions, nullptr, 0);
+    for (const auto& mesh : all_meshes) {
+        out.write(reinterpret_cast<const char*>(mesh->vertex_positions().data()),
+                  std::streamsize(mesh->vertex_positions().size() * sizeof(vec3)));
+    }
+    write_at(indices, nullptr, 0);
+    for (const auto& mesh : all_meshes) {
+        out.write(reinterpret_cast<const char*>(mesh->vertex_indices().data()),
+                  std::streamsize(mesh->vertex_indices().size() * sizeof(uint32_t)));
+    }
+    write_at(packs, nullptr, 0);
+    for (const auto& mesh : all_meshes) {
+        out.write(reinterpret_cast<const char*>(mesh->bvh().object_array().data()),
+                  std::streamsize(mesh->bvh().object_array().size() * sizeof(triangle_pack)));
+    }
+    write_at(pack_nodes, nullptr, 0);
+    for (const auto& mesh : all_meshes) {
+        out.write(reinterpret_cast<const char*>(mesh->bvh().node_array().data()),
+                  std::streamsize(mesh->bvh().node_array().size() * sizeof(pack_node)));
+    }
+    write_at(instances, instance_records.data(), instance_records.size() * sizeof(instance_record));
+    write_at(instance_nodes, instance_nodes_out.data(), instance_nodes_out.size() * sizeof(instance_node));
+    if (!out) {
+        error = "cannot write " + path;
+        return false;
+    }
+    return true;
+}
+
+
+// True if the file at path starts like a scene cache, i.e. should go to load_scene_cache()
+// rather than load_scene().
+inline bool is_scene_cache(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    char start[sizeof(scene_cache_detail::magic)] = {};
+    return in.read(start, sizeof(start)) && std::memcmp(start, scene_cache_detail::magic, sizeof(start)) == 0;
+}
+
+
+// Loads a scene compiled by write_scene_cache(). The file is memory mapped and its arrays are
+// copied straight into the primitives, meshes and BVHs of the scene; nothing is parsed or built.
+// Returns false and sets error if the file is not a cache of this build or is inconsistent.
+inline bool load_scene_cache(const std::string& path, scene& out, std::string& error) {
+    using namespace scene_cache_detail;
+
+    mapped_file file(path);
+    if (!file.is_open()) {
+        error = "cannot read " + path;
+        return false;
+    }
+    header h;
+    if (file.size() < sizeof(h) || std::memcmp(file.data(), magic, sizeof(magic)) != 0) {
+        error = path + ": not a scene cache";
+        return false;
+    }
+    std::memcpy(&h, file.data(), sizeof(h));
+    if (h.version != version || h.real_size != sizeof(real) || h.simd_width != uint32_t(simd_width)) {
+        error = path + ": scene cache was compiled by a different build, recompile the scene";
+        return false;
+    }
+    for (int id = 0; id < section_count; id++) {
+        const section& s = h.sections[id];
+        if (h.record_sizes[id] != record_size(id) || s.offset > file.size() ||
+            s.count > (file.size() - s.offset) / record_size(id)) {
+            error = path + ": scene cache was compiled by a different build or is truncated";
+            return false;
+        }
+    }
+
+    auto fail = [&]() {
+        error = path + ": corrupt scene cache";
+        return false;
+    };
+
+    std::vector<primitive> sphere_objects;
+    sphere_objects.reserve(h.sections[spheres].count);
+    for (const sphere_record& s : read_array<sphere_record>(file, h.sections[spheres])) {
+        sphere_objects.push_back(sphere(s.center, s.radius, s.mat));
+    }
+    std::vector<sphere_node> sphere_tree = read_array<sphere_node>(file, h.sections[sphere_nodes]);
+    if (!valid_tree<static_bvh>(sphere_tree, sphere_objects.size()))
+        return fail();
+
+    std::vector<shared_ptr<triangle_mesh>> mesh_list;
+    for (const mesh_record& m : read_array<mesh_record>(file, h.sections[meshes])) {
+        auto in_range = [](uint64_t first, uint64_t count, const section& s) {
+            return first <= s.count && count <= s.count - first;
+        };
+        if (!in_range(m.first_position, m.position_count, h.sections[positions]) ||
+            !in_range(m.first_index, m.index_count, h.sections[indices]) ||
+            !in_range(m.first_pack, m.pack_count, h.sections[packs]) ||
+            !in_range(m.first_node, m.node_count, h.sections[pack_nodes]))
+            return fail();
+
+        if (m.index_count % 3 != 0)
+            return fail();
+        auto mesh_indices = read_array<uint32_t>(file, h.sections[indices], m.first_index, m.index_count);
+        for (uint32_t index : mesh_indices) {
+            if (index >= m.position_count)
+                return fail();
+        }
+        auto mesh_packs = read_array<triangle_pack>(file, h.sections[packs], m.first_pack, m.pack_count);
+        for (const triangle_pack& pack : mesh_packs) {
+            if (!valid_pack(pack, m.index_count / 3))
+                return fail();
+        }
+        auto tree = read_array<pack_node>(file, h.sections[pack_nodes], m.first_node, m.node_count);
+        if (!valid_tree<basic_bvh<triangle_pack>>(tree, m.pack_count))
+            return fail();
+        basic_bvh<triangle_pack> bvh(std::move(mesh_packs), std::move(tree));
+        mesh_list.push_back(make_shared<triangle_mesh>(
+            read_array<vec3>(file, h.sections[positions], m.first_position, m.position_count),
+            std::move(mesh_indices), m.mat, std::move(bvh)));
+    }
+    if (h.world_mesh_count > mesh_list.size())
+        return fail();
+    std::vector<shared_ptr<triangle_mesh>> geometry_list(mesh_list.begin() + ptrdiff_t(h.world_mesh_count), mesh_list.end());
+    mesh_list.resize(h.world_mesh_count);
+
+    std::vector<instance> instance_objects;
+    instance_objects.reserve(h.sections[instances].count);
+    for (const instance_record& i : read_array<instance_record>(file, h.sections[instances])) {
+        if (i.geometry >= geometry_list.size())
+            return fail();
+        instance_objects.emplace_back(geometry_list[i.geometry], i.linear, i.offset);
+    }
+    std::vector<instance_node> instance_tree = read_array<instance_node>(file, h.sections[instance_nodes]);
+    if (!valid_tree<instance_bvh>(instance_tree, instance_objects.size()))
+        return fail();
+
+    out.view.lookfrom = vec3(h.lookfrom[0], h.lookfrom[1], h.lookfrom[2]);
+    out.view.yaw = h.yaw;
+    out.view.pitch = h.pitch;
+    out.view.vfov = h.vfov;
+    out.primitives = make_shared<static_bvh>(std::move(sphere_objects), std::move(sphere_tree));
+    out.meshes = std::move(mesh_list);
+    out.geometries = std::move(geometry_list);
+    out.instances = instance_objects.empty() ? nullptr
+                  : make_shared<instance_bvh>(std::move(instance_objects), std::move(instance_tree));
+    out.update_world();
+    return true;
+}
+
+#endif //SCENE_CACHE_H
@@ -0,0 +1,176 @@
+#ifndef SCREEN_BINS_H
+#define SCREEN_BINS_H
+
+#include "raytracer.h"
+#include "aabb.h"
+#include "hittable.h"
+#include "primitive.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+
+// The primitives of a primitive_list that one screen tile's primary rays can hit, as a hittable
+// over that subset. Cheap to make per tile: it refers to the list and to a range of indices.
+class binned_tile final : public hittable {
+public:
+    binned_tile(const primitive_list& world, const uint32_t* first, const uint32_t* last)
+        : world(world), first(first), last(last) {}
+
+    size_t size() const { return size_t(last - first); }
+
+    bool intersect(const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) const override {
+        bool hit_anything = false;
+        auto closest_so_far = ray_tmax;
+
+        for (const uint32_t* i = first; i != last; ++i) {
+            if (intersect_object(world.objects[*i], r, ray_tmin, closest_so_far, hit)) {
+                hit_anything = true;
+                closest_so_far = hit.t;
+            }
+        }
+        return hit_anything;
+    }
+
+    void intersect_packet(const ray_packet& packet, packet_hits& hits) const override {
+        for (const uint32_t* i = first; i != last; ++i) {
+            intersect_object_packet(world.objects[*i], packet, hits);
+        }
+    }
+
+    bool occluded(const ray& r, real ray_tmin, real ray_tmax) const override {
+        for (const uint32_t* i = first; i != last; ++i) {
+            if (occluded_object(world.objects[*i], r, ray_tmin, ray_tmax))
+                return true;
+        }
+        return false;
+    }
+
+    aabb bounding_box() const override { return world.bounding_box(); }
+
+private:
+    const primitive_list& world;
+    const uint32_t* first;
+    const uint32_t* last;
+};
+
+
+// Screen-space binning of a primitive_list for primary rays. Every primitive's bounding box is
+// projected onto the image, and the primitive is listed in each tile its projection overlaps.
+// A tile's primary rays then test only that tile's list. Their cost follows the depth complexity
+// under the tile rather than the scene's object count, without any acceleration structure.
+// Rebuilt every frame, as the view moves, in O(primitives + tiles covered).
+//
+// Boxes entirely behind the camera are dropped; boxes that straddle the camera plane have no
+// bounded projection and are listed in every tile.
+class screen_bins {
+public:
+    // Bins world for a pinhole at origin, whose ray through pixel coordinates (u, v) has
+    // direction pixel00 + u*delta_u + v*delta_v - origin, into tiles of tile_size pixels on a
+    // width x height image. Rays may pass anywhere within half a pixel of a pixel's center.
+    void build(const primitive_list& world, const vec3& origin, const vec3& pixel00,
+               const vec3& delta_u, const vec3& delta_v, int width, int height, int tile_size) {
+        tiles_x = (width + tile_size - 1) / tile_size;
+        tiles_y = (height + tile_size - 1) / tile_size;
+        int tile_count = tiles_x * tiles_y;
+
+        // Image plane normal, pointing away from the camera.
+        vec3 to_plane = pixel00 - origin;
+        vec3 normal = normalize(cross(delta_u, delta_v));
+        if (dot(normal, to_plane) < 0)
+            normal = -normal;
+        real plane_z = dot(to_plane, normal);
+        real inv_u = 1 / dot(delta_u, delta_u), inv_v = 1 / dot(delta_v, delta_v);
+
+        // Tile rectangle of every primitive, or an empty one.
+        rects.resize(world.objects.size());
+        for (size_t k = 0; k < world.objects.size(); k++) {
+            aabb box = object_bounds(world.objects[k]);
+            rect& out = rects[k];
+            out = rect{0, 0, -1, -1};
+            if (box.empty())
+                continue;
+
+            real u_min = INFINITY, u_max = -INFINITY, v_min = INFINITY, v_max = -INFINITY;
+            int in_front = 0;
+            for (int corner = 0; corner < 8; corner++) {
+                vec3 d = vec3(corner & 1 ? box.max.x : box.min.x,
+                              corner & 2 ? box.max.y : box.min.y,
+                              corner & 4 ? box.max.z : box.min.z) - origin;
+                real z = dot(d, normal);
+                if (z <= 0)
+                    continue;
+                in_front++;
+                vec3 q = d * (plane_z / z) - to_plane;
+                real u = dot(q, delta_u) * inv_u, v = dot(q, delta_v) * inv_v;
+                u_min = std::min(u_min, u);
+                u_max = std::max(u_max, u);
+                v_min = std::min(v_min, v);
+                v_max = std::max(v_max, v);
+            }
+            if (in_front == 0)
+                continue;
+            if (in_front < 8) {
+                out = rect{0, 0, tiles_x - 1, tiles_y - 1};
+                continue;
+            }
+            // Tile x covers pixel coordinates [x*tile_size - 0.5, (x+1)*tile_size - 0.5); one
+            // more pixel of margin absorbs rounding.
+            out.x0 = tile_index(u_min - real(1.5), tile_size, tiles_x);
+            out.x1 = tile_index(u_max + real(1.5), tile_size, tiles_x);
+            out.y0 = tile_index(v_min - real(1.5), tile_size, tiles_y);
+            out.y1 = tile_index(v_max + real(1.5), tile_size, tiles_y);
+            if (u_max < real(-1.5) || u_min > real(width + 0.5) || v_max < real(-1.5) || v_min > real(height + 0.5))
+                out = rect{0, 0, -1, -1};
+        }
+
+        // Count per tile, turn the counts into offsets, then fill in list order.
+        offsets.assign(size_t(tile_count) + 1, 0);
+        for (const rect& r : rects) {
+            for (int y = r.y0; y <= r.y1; y++) {
+                for (int x = r.x0; x <= r.x1; x++) {
+                    offsets[size_t(y * tiles_x + x) + 1]++;
+                }
+            }
+        }
+        for (int t = 0; t < tile_count; t++) {
+            offsets[size_t(t) + 1] += offsets[size_t(t)];
+        }
+        indices.resize(offsets[size_t(tile_count)]);
+        std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+        for (uint32_t k = 0; k < uint32_t(rects.size()); k++) {
+            const rect& r = rects[k];
+            for (int y = r.y0; y <= r.y1; y++) {
+                for (int x = r.x0; x <= r.x1; x++) {
+                    indices[fill[size_t(y * tiles_x + x)]++] = k;
+                }
+            }
+        }
+    }
+
+    // Primitives that tile t (numbered row by row) may see, in list order.
+    binned_tile tile(const primitive_list& world, int t) const {
+        return binned_tile(world, indices.data() + offsets[size_t(t)], indices.data() + offsets[size_t(t) + 1]);
+    }
+
+    // Total of all tile lists, for statistics; divided by the tile count, the mean depth complexity.
+    size_t binned_count() const { return indices.size(); }
+
+private:
+    struct rect {
+        int x0, y0, x1, y1;     // Inclusive tile range; empty when x1 < x0
+    };
+
+    int tiles_x = 0, tiles_y = 0;
+    std::vector<rect> rects;            // Per primitive, kept to avoid reallocating every frame
+    std::vector<uint32_t> offsets;      // Tile t lists indices[offsets[t], offsets[t + 1])
+    std::vector<uint32_t> indices;
+
+    static int tile_index(real pixel, int tile_size, int tiles) {
+        real t = std::floor((pixel + real(0.5)) / real(tile_size));
+        return int(std::clamp(t, real(0), real(tiles - 1)));
+    }
+};
+
+#endif //SCREEN_BINS_H
@@ -0,0 +1,222 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define RAYTRACER_SIMD_AVX512
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define RAYTRACER_SIMD_AVX2
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RAYTRACER_SIMD_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RAYTRACER_SIMD_NEON
+#endif
+
+
+// Thin wrapper over the widest float vector the target was compiled for: 16 lanes with AVX-512,
+// 8 with AVX2, 4 with SSE or NEON, and a plain 4-lane array otherwise. Kernels written against
+// vfloat/vmask compile to the best instruction set available without any per-ISA code.
+// Build with -march=native (the default, see CMakeLists.txt) to get AVX2/AVX-512 on x86.
+
+#if defined(RAYTRACER_SIMD_AVX512)
+
+constexpr int simd_width = 16;
+
+struct vmask {
+    __mmask16 m;
+    bool any() const { return m != 0; }
+    uint32_t bits() const { return m; }
+};
+
+struct vfloat {
+    __m512 v;
+    vfloat() {}
+    vfloat(__m512 v) : v(v) {}
+    vfloat(float f) : v(_mm512_set1_ps(f)) {}
+    static vfloat load(const float* p) { return _mm512_loadu_ps(p); }
+    void store(float* p) const { _mm512_storeu_ps(p, v); }
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return _mm512_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm512_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm512_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm512_div_ps(a.v, b.v); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm512_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm512_max_ps(a.v, b.v); }
+inline vfloat vsqrt(vfloat a) { return _mm512_sqrt_ps(a.v); }
+inline vmask operator<(vfloat a, vfloat b)  { return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ)}; }
+inline vmask operator<=(vfloat a, vfloat b) { return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ)}; }
+inline vmask operator>(vfloat a, vfloat b)  { return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ)}; }
+inline vmask operator>=(vfloat a, vfloat b) { return {_mm512_cmp_ps_mask(a.v, b.v, _CMP_GE_OQ)}; }
+inline vmask operator&(vmask a, vmask b) { return {__mmask16(a.m & b.m)}; }
+inline vmask operator|(vmask a, vmask b) { return {__mmask16(a.m | b.m)}; }
+inline vfloat select(vmask m, vfloat a, vfloat b) { return _mm512_mask_blend_ps(m.m, b.v, a.v); }
+
+#elif defined(RAYTRACER_SIMD_AVX2)
+
+constexpr int simd_width = 8;
+
+struct vmask {
+    __m256 m;
+    bool any() const { return _mm256_movemask_ps(m) != 0; }
+    uint32_t bits() const { return uint32_t(_mm256_movemask_ps(m)); }
+};
+
+struct vfloat {
+    __m256 v;
+    vfloat() {}
+    vfloat(__m256 v) : v(v) {}
+    vfloat(float f) : v(_mm256_set1_ps(f)) {}
+    static vfloat load(const float* p) { return _mm256_loadu_ps(p); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm256_div_ps(a.v, b.v); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a.v, b.v); }
+inline vfloat vsqrt(vfloat a) { return _mm256_sqrt_ps(a.v); }
+inline vmask operator<(vfloat a, vfloat b)  { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+inline vmask operator<=(vfloat a, vfloat b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+inline vmask operator>(vfloat a, vfloat b)  { return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)}; }
+inline vmask operator>=(vfloat a, vfloat b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+inline vmask operator&(vmask a, vmask b) { return {_mm256_and_ps(a.m, b.m)}; }
+inline vmask operator|(vmask a, vmask b) { return {_mm256_or_ps(a.m, b.m)}; }
+inline vfloat select(vmask m, vfloat a, vfloat b) { return _mm256_blendv_ps(b.v, a.v, m.m); }
+
+#elif defined(RAYTRACER_SIMD_SSE)
+
+constexpr int simd_width = 4;
+
+struct vmask {
+    __m128 m;
+    bool any() const { return _mm_movemask_ps(m) != 0; }
+    uint32_t bits() const { return uint32_t(_mm_movemask_ps(m)); }
+};
+
+struct vfloat {
+    __m128 v;
+    vfloat() {}
+    vfloat(__m128 v) : v(v) {}
+    vfloat(float f) : v(_mm_set1_ps(f)) {}
+    static vfloat load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return _mm_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm_div_ps(a.v, b.v); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a.v, b.v); }
+inline vfloat vsqrt(vfloat a) { return _mm_sqrt_ps(a.v); }
+inline vmask operator<(vfloat a, vfloat b)  { return {_mm_cmplt_ps(a.v, b.v)}; }
+inline vmask operator<=(vfloat a, vfloat b) { return {_mm_cmple_ps(a.v, b.v)}; }
+inline vmask operator>(vfloat a, vfloat b)  { return {_mm_cmpgt_ps(a.v, b.v)}; }
+inline vmask operator>=(vfloat a, vfloat b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+inline vmask operator&(vmask a, vmask b) { return {_mm_and_ps(a.m, b.m)}; }
+inline vmask operator|(vmask a, vmask b) { return {_mm_or_ps(a.m, b.m)}; }
+inline vfloat select(vmask m, vfloat a, vfloat b) {
+    return _mm_or_ps(_mm_and_ps(m.m, a.v), _mm_andnot_ps(m.m, b.v));
+}
+
+#elif defined(RAYTRACER_SIMD_NEON)
+
+constexpr int simd_width = 4;
+
+struct vmask {
+    uint32x4_t m;
+    bool any() const { return vmaxvq_u32(m) != 0; }
+    uint32_t bits() const {
+        const uint32_t weights[4] = {1, 2, 4, 8};
+        return vaddvq_u32(vandq_u32(m, vld1q_u32(weights)));
+    }
+};
+
+struct vfloat {
+    float32x4_t v;
+    vfloat() {}
+    vfloat(float32x4_t v) : v(v) {}
+    vfloat(float f) : v(vdupq_n_f32(f)) {}
+    static vfloat load(const float* p) { return vld1q_f32(p); }
+    void store(float* p) const { vst1q_f32(p, v); }
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return vaddq_f32(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return vsubq_f32(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return vmulq_f32(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return vdivq_f32(a.v, b.v); }
+inline vfloat vmin(vfloat a, vfloat b) { return vminq_f32(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b) { return vmaxq_f32(a.v, b.v); }
+inline vfloat vsqrt(vfloat a) { return vsqrtq_f32(a.v); }
+inline vmask operator<(vfloat a, vfloat b)  { return {vcltq_f32(a.v, b.v)}; }
+inline vmask operator<=(vfloat a, vfloat b) { return {vcleq_f32(a.v, b.v)}; }
+inline vmask operator>(vfloat a, vfloat b)  { return {vcgtq_f32(a.v, b.v)}; }
+inline vmask operator>=(vfloat a, vfloat b) { return {vcgeq_f32(a.v, b.v)}; }
+inline vmask operator&(vmask a, vmask b) { return {vandq_u32(a.m, b.m)}; }
+inline vmask operator|(vmask a, vmask b) { return {vorrq_u32(a.m, b.m)}; }
+inline vfloat select(vmask m, vfloat a, vfloat b) { return vbslq_f32(m.m, a.v, b.v); }
+
+#else
+
+// Scalar fallback: plain loops over a 4-wide array, which compilers can still auto-vectorize.
+constexpr int simd_width = 4;
+
+struct vmask {
+    bool m[simd_width];
+    bool any() const { return m[0] || m[1] || m[2] || m[3]; }
+    uint32_t bits() const {
+        uint32_t b = 0;
+        for (int i = 0; i < simd_width; i++) b |= uint32_t(m[i]) << i;
+        return b;
+    }
+};
+
+struct vfloat {
+    float v[simd_width];
+    vfloat() {}
+    vfloat(float f) { for (int i = 0; i < simd_width; i++) v[i] = f; }
+    static vfloat load(const float* p) { vfloat r; for (int i = 0; i < simd_width; i++) r.v[i] = p[i]; return r; }
+    void store(float* p) const { for (int i = 0; i < simd_width; i++) p[i] = v[i]; }
+};
+
+#define RAYTRACER_SIMD_LANEWISE(RESULT, EXPR) \
+    RESULT r; for (int i = 0; i < simd_width; i++) r.EXPR; return r;
+inline vfloat operator+(vfloat a, vfloat b) { RAYTRACER_SIMD_LANEWISE(vfloat, v[i] = a.v[i] + b.v[i]) }
+inline vfloat operator-(vfloat a, vfloat b) { RAYTRACER_SIMD_LANEWISE(vfloat, v[i] = a.v[i] - b.v[i]) }
+inline vfloat operator*(vfloat a, vfloat b) { RAYTRACER_SIMD_LANEWISE(vfloat, v[i] = a.v[i] * b.v[i]) }
+inline vfloat operator/(vfloat a, vfloat b) { RAYTRACER_SIMD_LANEWISE(vfloat, v[i] = a.v[i] / b.v[i]) }
+inline vfloat vmin(vfloat a, vfloat b) { RAYTRACER_SIMD_LANEWISE(vfloat, v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i]) }
+inline vfloat vmax(vfloat a, vfloat b) { RAYTRACER_SIMD_LANEWISE(vfloat, v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i]) }
+inline vfloat vsqrt(vfloat a) { RAYTRACER_SIMD_LANEWISE(vfloat, v[i] = std::sqrt(a.v[i])) }
+inline vmask operator<(vfloat a, vfloat b)  { RAYTRACER_SIMD_LANEWISE(vmask, m[i] = a.v[i] < b.v[i]) }
+inline vmask operator<=(vfloat a, vfloat b) { RAYTRACER_SIMD_LANEWISE(vmask, m[i] = a.v[i] <= b.v[i]) }
+inline vmask operator>(vfloat a, vfloat b)  { RAYTRACER_SIMD_LANEWISE(vmask, m[i] = a.v[i] > b.v[i]) }
+inline vmask operator>=(vfloat a, vfloat b) { RAYTRACER_SIMD_LANEWISE(vmask, m[i] = a.v[i] >= b.v[i]) }
+inline vmask operator&(vmask a, vmask b) { RAYTRACER_SIMD_LANEWISE(vmask, m[i] = a.m[i] && b.m[i]) }
+inline vmask operator|(vmask a, vmask b) { RAYTRACER_SIMD_LANEWISE(vmask, m[i] = a.m[i] || b.m[i]) }
+inline vfloat select(vmask m, vfloat a, vfloat b) { RAYTRACER_SIMD_LANEWISE(vfloat, v[i] = m.m[i] ? a.v[i] : b.v[i]) }
+#undef RAYTRACER_SIMD_LANEWISE
+
+#endif
+
+// Index of the lowest set bit, i.e. the first active lane of a mask.
+inline int first_lane(uint32_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctz(bits);
+#else
+    int i = 0;
+    while (!(bits & 1u)) { bits >>= 1; i++; }
+    return i;
+#endif
+}
+
+#endif //SIMD_H
@@ -2,12 +2,84 @@
 #define SPHERE_H
 
 #include "raytracer.h"
+#include "hittable.h"
+#include "material.h"
+#include "simd.h"
 
-class sphere : public hittable {
+#include <algorithm>
+#include <cstdint>
+
+// One sphere against every ray of a packet, simd_width rays at a time. The packet's rays share
+// an origin, so the origin-to-center terms are the same for all of them. Calls
+// found(i, lanes, root) for each group of rays starting at i with a hit in (packet.tmin, t_max[ray]):
+// lanes holds a bit per ray with such a hit, root the distances.
+template <typename Found>
+inline void sphere_packet_hits(const vec3& center, float radius, const ray_packet& packet, const float* t_max,
+                               Found&& found) {
+    vec3 oc = center - packet.origin;
+    vfloat ocx(oc.x), ocy(oc.y), ocz(oc.z);
+    vfloat c(dot(oc, oc) - radius*radius);
+    vfloat tmin(packet.tmin);
+
+    for (int i = 0; i < ray_packet::size; i += simd_width) {
+        vfloat dx = vfloat::load(&packet.dir_x[i]);
+        vfloat dy = vfloat::load(&packet.dir_y[i]);
+        vfloat dz = vfloat::load(&packet.dir_z[i]);
+        vfloat a = dx*dx + dy*dy + dz*dz;
+        vfloat h = dx*ocx + dy*ocy + dz*ocz;
+        vfloat discriminant = h*h - a*c;
+        vmask hit_mask = discriminant >= vfloat(0.0f);
+        if (!hit_mask.any())
+            continue;
+
+        vfloat sqrtd = vsqrt(vmax(discriminant, vfloat(0.0f)));
+        vfloat root_near = (h - sqrtd) / a;
+        vfloat root_far  = (h + sqrtd) / a;
+        vfloat root = select(root_near > tmin, root_near, root_far);
+        uint32_t lanes = (hit_mask & (root > tmin) & (root < vfloat::load(&t_max[i]))).bits();
+        if (lanes)
+            found(i, lanes, root);
+    }
+}
+
+// Closest hits of a packet with one sphere, recorded as part prim of object.
+inline void intersect_sphere_packet(const vec3& center, float radius, const hittable* object, uint32_t prim,
+                                    const ray_packet& packet, packet_hits& hits) {
+    sphere_packet_hits(center, radius, packet, hits.t, [&](int i, uint32_t closer, const vfloat& root) {
+        float roots[simd_width];
+        root.store(roots);
+        for (; closer; closer &= closer - 1) {
+            int lane = first_lane(closer);
+            hits.record(i + lane, ray_hit{roots[lane], object, nullptr, prim});
+        }
+    });
+}
+
+inline void occlude_sphere_packet(const vec3& center, float radius, const ray_packet& packet, packet_occlusion& occlusion) {
+    sphere_packet_hits(center, radius, packet, occlusion.t, [&](int i, uint32_t blocked, const vfloat&) {
+        for (; blocked; blocked &= blocked - 1) {
+            occlusion.set_occluded(i + first_lane(blocked));
+        }
+    });
+}
+
+// Position, normal and UV at distance t along r on a sphere. u runs around the y axis from -x,
+// v from the bottom pole to the top.
+inline void sphere_surface(const ray& r, real t, const vec3& center, real radius, hit_record& rec) {
+    rec.p = r.at(t);
+    vec3 outward_normal = (rec.p - center) / radius;
+    rec.set_face_normal(r, outward_normal);
+    real theta = std::acos(std::clamp(-outward_normal.y, real(-1), real(1)));
+    real phi = std::atan2(-outward_normal.z, outward_normal.x) + pi;
+    rec.uv = vec2(phi / (2*pi), theta / pi);
+}
+
+class sphere final : public hittable {
 public:
-    sphere(const vec3& center, float radius) : center(center), radius(radius) {}
+    sphere(const vec3& center, real radius, const material& mat = material::diffuse(color(0.5, 0.5, 0.5)))
+        : center(center), radius(radius), mat(mat) {}
 
-    bool hit(const ray& r, double ray_tmin, double ray_tmax, hit_record& rec) const override {
+    bool intersect(const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) const override {
         vec3 oc = center - r.origin();
         auto a = dot(r.direction(), r.direction());
         auto h = dot(r.direction(), oc);
@@ -27,17 +99,38 @@ public:
                 return false;
         }
 
-        rec.t = root;
-        rec.p = r.at(rec.t);
-        vec3 outward_normal = (rec.p - center) / float(radius);
-        rec.set_face_normal(r, outward_normal);
-
+        hit = ray_hit{root, this, nullptr, 0};
         return true;
     }
 
+    void intersect_packet(const ray_packet& packet, packet_hits& hits) const override {
+        if (packet.frustum_overlaps(bounding_box()))
+            intersect_sphere_packet(center, float(radius), this, 0, packet, hits);
+    }
+
+    void occluded_packet(const ray_packet& packet, packet_occlusion& occlusion) const override {
+        if (packet.frustum_overlaps(bounding_box()))
+            occlude_sphere_packet(center, float(radius), packet, occlusion);
+    }
+
+    void surface(const ray& r, const ray_hit& hit, hit_record& rec) const override {
+        sphere_surface(r, hit.t, center, radius, rec);
+        rec.mat = &mat;
+    }
+
+    const vec3& get_center() const { return center; }
+    real get_radius() const { return radius; }
+    const material& get_material() const { return mat; }
+
+    aabb bounding_box() const override {
+        vec3 rvec = vec3(radius, radius, radius);
+        return aabb(center - rvec, center + rvec);
+    }
+
 private:
     vec3 center;
-    double radius;
+    real radius;
+    material mat;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,177 @@
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+#include "raytracer.h"
+#include "hittable.h"
+#include "simd.h"
+#include "sphere.h"
+
+#include <vector>
+
+
+// Collection of spheres stored as structure-of-arrays float columns, intersected simd_width
+// spheres at a time (see simd.h). Compared to a hittable_list of sphere objects there is no
+// pointer chasing and no virtual call per sphere, and the loads are contiguous.
+// The columns are padded to a multiple of simd_width with spheres that can never be hit.
+class sphere_set : public hittable {
+public:
+    sphere_set() {}
+
+    void clear() {
+        center_x.clear(); center_y.clear(); center_z.clear();
+        radius.clear(); radius_sq.clear();
+        materials.clear();
+        count = 0;
+        bbox = aabb();
+    }
+
+    void add(const vec3& center, float r, const material& mat = material::diffuse(color(0.5, 0.5, 0.5))) {
+        // Overwrite the first padding slot, or open up a new block of padding.
+        if (count == center_x.size()) {
+            center_x.resize(count + simd_width, 0.0f);
+            center_y.resize(count + simd_width, 0.0f);
+            center_z.resize(count + simd_width, 0.0f);
+            radius.resize(count + simd_width, 1.0f);
+            // c = |oc|^2 - r^2 becomes +inf, so the discriminant is -inf for padding spheres.
+            radius_sq.resize(count + simd_width, -INFINITY);
+        }
+        center_x[count] = center.x;
+        center_y[count] = center.y;
+        center_z[count] = center.z;
+        radius[count] = r;
+        radius_sq[count] = r*r;
+        materials.push_back(mat);
+        ++count;
+
+        vec3 rvec = vec3(r, r, r);
+        bbox.expand(aabb(center - rvec, center + rvec));
+    }
+
+    size_t size() const { return count; }
+
+    vec3 center(size_t i) const { return vec3(center_x[i], center_y[i], center_z[i]); }
+
+    bool intersect(const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) const override {
+        float t;
+        int index = find_hit<false>(r, float(ray_tmin), float(ray_tmax), t);
+        if (index < 0)
+            return false;
+
+        hit = ray_hit{t, this, nullptr, uint32_t(index)};
+        return true;
+    }
+
+    bool occluded(const ray& r, real ray_tmin, real ray_tmax) const override {
+        float t;
+        return find_hit<true>(r, float(ray_tmin), float(ray_tmax), t) >= 0;
+    }
+
+    void intersect_packet(const ray_packet& packet, packet_hits& hits) const override {
+        for_each_visible(packet, [&](size_t index) {
+            intersect_sphere_packet(center(index), radius[index], this, uint32_t(index), packet, hits);
+        });
+    }
+
+    void occluded_packet(const ray_packet& packet, packet_occlusion& occlusion) const override {
+        for_each_visible(packet, [&](size_t index) {
+            occlude_sphere_packet(center(index), radius[index], packet, occlusion);
+        });
+    }
+
+    void surface(const ray& r, const ray_hit& hit, hit_record& rec) const override {
+        sphere_surface(r, hit.t, center(hit.prim), real(radius[hit.prim]), rec);
+        rec.mat = &materials[hit.prim];
+    }
+
+    aabb bounding_box() const override { return bbox; }
+
+private:
+    std::vector<float> center_x, center_y, center_z;
+    std::vector<float> radius, radius_sq;
+    std::vector<material> materials;   // One per sphere, not padded
+    size_t count = 0;
+    aabb bbox;
+
+    // Culls simd_width spheres at a time against the packet frustum and calls visit(index) for
+    // each sphere that survives, which then runs a packet kernel (simd_width rays per iteration).
+    template <typename Visit>
+    void for_each_visible(const ray_packet& packet, Visit&& visit) const {
+        const vec3& o = packet.origin;
+        for (size_t i = 0; i < center_x.size(); i += simd_width) {
+            vfloat ocx = vfloat::load(&center_x[i]) - vfloat(o.x);
+            vfloat ocy = vfloat::load(&center_y[i]) - vfloat(o.y);
+            vfloat ocz = vfloat::load(&center_z[i]) - vfloat(o.z);
+            vfloat neg_radius = vfloat(0.0f) - vfloat::load(&radius[i]);
+            vmask inside = neg_radius <= vfloat(0.0f);
+            for (int k = 0; k < 4; k++) {
+                const vec3& n = packet.frustum_plane(k);
+                inside = inside & (vfloat(n.x)*ocx + vfloat(n.y)*ocy + vfloat(n.z)*ocz >= neg_radius);
+            }
+            for (uint32_t bits = inside.bits(); bits; bits &= bits - 1) {
+                size_t index = i + first_lane(bits);
+                if (index < count)
+                    visit(index);
+            }
+        }
+    }
+
+    // Same quadratic as sphere::intersect, evaluated for simd_width spheres per iteration. Each
+    // lane keeps its own closest t and the block it came from; the lanes are reduced once at the
+    // end. With any_hit, returns at the first block with a hit instead, and t_out is not set.
+    // Returns the index of the closest (or any) sphere hit in (tmin, tmax), or -1.
+    template <bool any_hit>
+    int find_hit(const ray& r, float tmin, float tmax, float& t_out) const {
+        const vec3& o = r.origin();
+        const vec3& d = r.direction();
+        vfloat ox(o.x), oy(o.y), oz(o.z);
+        vfloat dx(d.x), dy(d.y), dz(d.z);
+        float a = dot(d, d);
+        vfloat va(a), inv_a(1.0f / a);
+        vfloat vtmin(tmin);
+
+        vfloat best_t(tmax);
+        vfloat best_block(-1.0f);
+        for (size_t i = 0; i < center_x.size(); i += simd_width) {
+            vfloat ocx = vfloat::load(&center_x[i]) - ox;
+            vfloat ocy = vfloat::load(&center_y[i]) - oy;
+            vfloat ocz = vfloat::load(&center_z[i]) - oz;
+            vfloat h = dx*ocx + dy*ocy + dz*ocz;
+            vfloat c = ocx*ocx + ocy*ocy + ocz*ocz - vfloat::load(&radius_sq[i]);
+            vfloat discriminant = h*h - va*c;
+            vmask hit_mask = discriminant >= vfloat(0.0f);
+            if (!hit_mask.any())
+                continue;
+
+            // Nearest root in range, falling back to the far root when the near one is behind tmin.
+            vfloat sqrtd = vsqrt(vmax(discriminant, vfloat(0.0f)));
+            vfloat root_near = (h - sqrtd) * inv_a;
+            vfloat root_far  = (h + sqrtd) * inv_a;
+            vfloat root = select(root_near > vtmin, root_near, root_far);
+            vmask closer = hit_mask & (root > vtmin) & (root < best_t);
+            if constexpr (any_hit) {
+                if (uint32_t bits = closer.bits())
+                    return int(i) + first_lane(bits);
+            } else {
+                best_t = select(closer, root, best_t);
+                best_block = select(closer, vfloat(float(i / simd_width)), best_block);
+            }
+        }
+
+        float lane_t[simd_width], lane_block[simd_width];
+        best_t.store(lane_t);
+        best_block.store(lane_block);
+        int best = -1;
+        float t = tmax;
+        for (int lane = 0; lane < simd_width; lane++) {
+            if (lane_block[lane] >= 0.0f && lane_t[lane] < t) {
+                t = lane_t[lane];
+                best = int(lane_block[lane]) * simd_width + lane;
+            }
+        }
+        if (best >= 0)
+            t_out = t;
+        return best;
+    }
+};
+
+#endif //SPHERE_SET_H
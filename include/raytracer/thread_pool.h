@@ -0,0 +1,195 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include "cpu_topology.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Persistent pool of worker threads that runs a batch of indexed tasks (e.g. image tiles).
+// Each worker starts with a contiguous slice of the batch and, when it runs dry, steals half
+// of the remaining work from another worker, so expensive tiles don't leave cores idle.
+// The calling thread takes part as worker 0, so a pool of N threads spawns N-1 threads.
+// With pin_threads set, worker i is bound to the i-th CPU of cpu_placement_order(), which spreads
+// workers over physical cores before doubling up on SMT siblings.
+class thread_pool {
+public:
+    // When one worker ran during the last parallel_for, and how many tasks it completed.
+    struct worker_span {
+        std::chrono::steady_clock::time_point start, end;
+        int tasks = 0;
+    };
+
+    explicit thread_pool(int num_threads, bool pin_threads = false) : pinned(pin_threads) {
+        if (num_threads < 1)
+            num_threads = 1;
+        if (pinned)
+            placement = cpu_placement_order();
+        queues = std::vector<task_range>(num_threads);
+        spans = std::vector<timed_span>(num_threads);
+        for (int i = 1; i < num_threads; i++) {
+            workers.emplace_back([this, i](){ worker_main(i); });
+        }
+    }
+
+    ~thread_pool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        start_cv.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    thread_pool(const thread_pool&) = delete;
+    thread_pool& operator=(const thread_pool&) = delete;
+
+    int size() const { return int(queues.size()); }
+    bool pins_threads() const { return pinned; }
+
+    // Timing of each worker in the last completed parallel_for, e.g. to measure load imbalance.
+    worker_span last_span(int worker) const { return spans[worker].span; }
+
+    // Runs task(index, worker) for every index in [0, num_tasks) and blocks until all have finished.
+    void parallel_for(int num_tasks, const std::function<void(int, int)>& task) {
+        if (num_tasks <= 0)
+            return;
+        if (caller != std::this_thread::get_id()) {
+            caller = std::this_thread::get_id();
+            pin(0);
+        }
+
+        // Hand out an even, contiguous slice to each worker; stealing fixes up any imbalance.
+        int n = size();
+        for (int w = 0; w < n; w++) {
+            uint32_t begin = uint32_t(int64_t(num_tasks) * w / n);
+            uint32_t end   = uint32_t(int64_t(num_tasks) * (w+1) / n);
+            queues[w].range.store(pack(begin, end), std::memory_order_relaxed);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = &task;
+            busy_workers = n - 1;
+            ++generation;
+        }
+        start_cv.notify_all();
+
+        run_tasks(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done_cv.wait(lock, [this](){ return busy_workers == 0; });
+        job = nullptr;
+    }
+
+private:
+    // Half-open range [begin, end) of task indices, packed into one word so the owner popping
+    // from the front and thieves splitting off the back can both update it with a single CAS.
+    struct alignas(64) task_range {
+        std::atomic<uint64_t> range{0};
+    };
+
+    struct alignas(64) timed_span {
+        worker_span span;
+    };
+
+    std::vector<task_range> queues;
+    std::vector<timed_span> spans;  // One per worker, each written only by its own worker
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable start_cv;
+    std::condition_variable done_cv;
+    const std::function<void(int, int)>* job = nullptr;
+    uint64_t generation = 0;
+    int busy_workers = 0;
+    bool stopping = false;
+
+    bool pinned;
+    std::vector<int> placement;  // CPU for each worker when pinned, see cpu_placement_order()
+    std::thread::id caller;      // Thread last pinned as worker 0
+
+    static uint64_t pack(uint32_t begin, uint32_t end) { return (uint64_t(end) << 32) | begin; }
+    static uint32_t range_begin(uint64_t r) { return uint32_t(r); }
+    static uint32_t range_end(uint64_t r) { return uint32_t(r >> 32); }
+
+    void pin(int id) {
+        if (pinned && !placement.empty())
+            pin_current_thread(placement[id % placement.size()]);
+    }
+
+    void worker_main(int id) {
+        pin(id);
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                start_cv.wait(lock, [this, seen](){ return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+            }
+
+            run_tasks(id);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busy_workers == 0)
+                done_cv.notify_one();
+        }
+    }
+
+    void run_tasks(int id) {
+        const auto& task = *job;
+        worker_span& span = spans[id].span;
+        span.start = std::chrono::steady_clock::now();
+        span.tasks = 0;
+        int index;
+        while ((index = pop(id)) >= 0 || (index = steal(id)) >= 0) {
+            task(index, id);
+            ++span.tasks;
+        }
+        span.end = std::chrono::steady_clock::now();
+    }
+
+    // Takes the next task from the front of this worker's own range.
+    int pop(int id) {
+        auto& range = queues[id].range;
+        uint64_t r = range.load(std::memory_order_relaxed);
+        while (range_begin(r) < range_end(r)) {
+            if (range.compare_exchange_weak(r, pack(range_begin(r) + 1, range_end(r)), std::memory_order_acq_rel))
+                return int(range_begin(r));
+        }
+        return -1;
+    }
+
+    // Splits off the back half of another worker's range, keeps it as our own range and
+    // returns its first task. Returns -1 once every queue is empty.
+    int steal(int id) {
+        int n = size();
+        for (int k = 1; k < n; k++) {
+            auto& victim = queues[(id + k) % n].range;
+            uint64_t r = victim.load(std::memory_order_relaxed);
+            while (range_begin(r) < range_end(r)) {
+                uint32_t begin = range_begin(r), end = range_end(r);
+                uint32_t split = end - (end - begin + 1) / 2;
+                if (victim.compare_exchange_weak(r, pack(begin, split), std::memory_order_acq_rel)) {
+                    queues[id].range.store(pack(split + 1, end), std::memory_order_release);
+                    return int(split);
+                }
+            }
+        }
+        return -1;
+    }
+};
+
+#endif //THREAD_POOL_H
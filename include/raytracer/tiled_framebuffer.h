@@ -0,0 +1,126 @@
+#ifndef TILED_FRAMEBUFFER_H
+#define TILED_FRAMEBUFFER_H
+
+#include "raytracer.h"
+#include "color.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <vector>
+
+
+// Per-pixel sample sums of a frame, stored the way render threads produce them: tile by tile,
+// each tile one contiguous block, with the pixels inside a tile in Morton (Z) order. A thread
+// tracing a tile thus writes memory no other thread touches, with no cache line shared across
+// tile boundaries. Pixels that are close on screen are also close in memory, in both directions.
+// detile() converts a finished tile into the interleaved RGB bytes of a row-major image.
+//
+// Tiles are stored as squares of tile_size rounded up to a power of two, so the Morton index of
+// every pixel of a tile fits. A pixel's slot is the sum of a per-column and a per-row part, both
+// tabulated, so addressing takes two loads and no division.
+class tiled_framebuffer {
+public:
+    // Returns true if the layout changed, which drops the stored sums.
+    bool resize(int w, int h, int size) {
+        if (w == width && h == height && size == tile_size)
+            return false;
+        width = w;
+        height = h;
+        tile_size = size;
+        tiles_x = (width + tile_size - 1) / tile_size;
+        span_bits = 0;
+        while ((1 << span_bits) < tile_size) {
+            span_bits++;
+        }
+        size_t count = size_t(tiles_x) * size_t((height + tile_size - 1) / tile_size) << (2 * span_bits);
+        data.reset(static_cast<color*>(::operator new[](count * sizeof(color), std::align_val_t(64))));
+
+        column_offsets.resize(size_t(width));
+        for (int i = 0; i < width; i++) {
+            int tx = i / tile_size;
+            column_offsets[size_t(i)] = (size_t(tx) << (2 * span_bits)) + spread(uint32_t(i - tx*tile_size));
+        }
+        row_offsets.resize(size_t(height));
+        for (int j = 0; j < height; j++) {
+            int ty = j / tile_size;
+            row_offsets[size_t(j)] = (size_t(ty) * size_t(tiles_x) << (2 * span_bits)) + (spread(uint32_t(j - ty*tile_size)) << 1);
+        }
+        return true;
+    }
+
+    // Sample sum of pixel (i, j).
+    color& at(int i, int j) { return data[column_offsets[size_t(i)] + row_offsets[size_t(j)]]; }
+    const color& at(int i, int j) const { return data[column_offsets[size_t(i)] + row_offsets[size_t(j)]]; }
+
+    // Writes the pixels [x0, x1) x [y0, y1) of a tile into the row-major RGB image pixels,
+    // as the average of samples samples each. With gamma, colors are linear radiance, gamma
+    // corrected (gamma 2) on the way. Values are clamped to [0, 1].
+    void detile(unsigned char* pixels, int x0, int y0, int x1, int y1, int samples, bool gamma) const {
+        for (int j = y0; j < y1; j++) {
+            unsigned char* out = pixels + 3 * (size_t(j) * size_t(width) + size_t(x0));
+            const color* row = &data[row_offsets[size_t(j)]];
+            for (int i = x0; i < x1; i++) {
+                color c = row[column_offsets[size_t(i)]] / real(samples);
+                *out++ = to_byte(c.x, gamma);
+                *out++ = to_byte(c.y, gamma);
+                *out++ = to_byte(c.z, gamma);
+            }
+        }
+    }
+
+    // Calls visit(x, y) for every cell of a w x h grid, in Morton order.
+    template <typename Visit>
+    static void for_each_morton(int w, int h, Visit&& visit) {
+        uint32_t side = 1;
+        while (side < uint32_t(std::max(w, h))) {
+            side *= 2;
+        }
+        for (uint32_t index = 0; index < side * side; index++) {
+            int x = int(compact(index)), y = int(compact(index >> 1));
+            if (x < w && y < h)
+                visit(x, y);
+        }
+    }
+
+private:
+    struct aligned_delete {
+        void operator()(color* p) const { ::operator delete[](p, std::align_val_t(64)); }
+    };
+
+    int width = 0, height = 0, tile_size = 0;
+    int tiles_x = 0;
+    int span_bits = 0;
+    std::unique_ptr<color[], aligned_delete> data;
+    std::vector<size_t> column_offsets;     // Tile and Morton x bits of each column
+    std::vector<size_t> row_offsets;        // Tile row and Morton y bits of each row
+
+    // Bits of a coordinate below 2^16 moved to the even bit positions; a Morton index is
+    // spread(x) | spread(y) << 1.
+    static uint32_t spread(uint32_t v) {
+        v &= 0x0000FFFFU;
+        v = (v | (v << 8)) & 0x00FF00FFU;
+        v = (v | (v << 4)) & 0x0F0F0F0FU;
+        v = (v | (v << 2)) & 0x33333333U;
+        v = (v | (v << 1)) & 0x55555555U;
+        return v;
+    }
+
+    static uint32_t compact(uint32_t v) {
+        v &= 0x55555555U;
+        v = (v | (v >> 1)) & 0x33333333U;
+        v = (v | (v >> 2)) & 0x0F0F0F0FU;
+        v = (v | (v >> 4)) & 0x00FF00FFU;
+        v = (v | (v >> 8)) & 0x0000FFFFU;
+        return v;
+    }
+
+    static unsigned char to_byte(real value, bool gamma) {
+        if (gamma)
+            value = std::sqrt(std::max(value, real(0)));
+        return (unsigned char)(std::clamp(value, real(0), real(1)) * real(255.9));
+    }
+};
+
+#endif //TILED_FRAMEBUFFER_H
@@ -0,0 +1,291 @@
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include "raytracer.h"
+#include "aabb.h"
+#include "bvh.h"
+#include "hittable.h"
+#include "material.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+// simd_width triangles of a mesh stored structure-of-arrays, indexed [axis][lane], for the
+// multi-triangle kernel below. Lanes past the end of the mesh hold NaN vertices, which no ray hits.
+struct triangle_pack {
+    alignas(64) float v0[3][simd_width];
+    alignas(64) float v1[3][simd_width];
+    alignas(64) float v2[3][simd_width];
+    uint32_t triangle[simd_width];      // Index of the triangle in its mesh
+    aabb bbox;
+};
+
+
+// Per-ray setup of the watertight ray/triangle test: the ray's dominant axis becomes z, and the
+// shear that maps the ray direction onto +z. Computed once per ray and pack.
+struct ray_shear {
+    int kx, ky, kz;
+    float sx, sy, sz;
+    float origin[3];
+
+    explicit ray_shear(const ray& r) {
+        vec3 d = r.direction();
+        vec3 a = glm::abs(d);
+        kz = a.x > a.y ? (a.x > a.z ? 0 : 2) : (a.y > a.z ? 1 : 2);
+        kx = (kz + 1) % 3;
+        ky = (kx + 1) % 3;
+        if (d[kz] < 0)
+            std::swap(kx, ky);     // Keep the winding, so the sign of the edge functions means the same
+        sx = float(d[kx] / d[kz]);
+        sy = float(d[ky] / d[kz]);
+        sz = float(1 / d[kz]);
+        for (int axis = 0; axis < 3; axis++) {
+            origin[axis] = float(r.origin()[axis]);
+        }
+    }
+};
+
+
+// Watertight ray/triangle test (Woop, Benthin and Wald, "Watertight Ray/Triangle Intersection",
+// JCGT 2013) of one ray against the simd_width triangles of a pack at once. The vertices are
+// moved into a space where the ray starts at the origin and runs along +z, where the triangle test
+// becomes three 2D edge functions. An edge shared by two triangles yields the same edge function
+// value for both, so a ray can't slip through the crack between them. Edge hits count as inside.
+// Returns a bit per lane whose triangle is hit with t in (tmin, tmax); t holds the distances.
+inline uint32_t triangle_pack_hits(const triangle_pack& pack, const ray_shear& shear, float tmin, float tmax, vfloat& t) {
+    int kx = shear.kx, ky = shear.ky, kz = shear.kz;
+    vfloat ox(shear.origin[kx]), oy(shear.origin[ky]), oz(shear.origin[kz]);
+    vfloat sx(shear.sx), sy(shear.sy), sz(shear.sz);
+
+    vfloat az = vfloat::load(pack.v0[kz]) - oz;
+    vfloat bz = vfloat::load(pack.v1[kz]) - oz;
+    vfloat cz = vfloat::load(pack.v2[kz]) - oz;
+    vfloat ax = vfloat::load(pack.v0[kx]) - ox - sx*az;
+    vfloat ay = vfloat::load(pack.v0[ky]) - oy - sy*az;
+    vfloat bx = vfloat::load(pack.v1[kx]) - ox - sx*bz;
+    vfloat by = vfloat::load(pack.v1[ky]) - oy - sy*bz;
+    vfloat cx = vfloat::load(pack.v2[kx]) - ox - sx*cz;
+    vfloat cy = vfloat::load(pack.v2[ky]) - oy - sy*cz;
+
+    vfloat u = cx*by - cy*bx;
+    vfloat v = ax*cy - ay*cx;
+    vfloat w = bx*ay - by*ax;
+    vfloat zero(0.0f);
+    vmask inside = ((u >= zero) & (v >= zero) & (w >= zero)) | ((u <= zero) & (v <= zero) & (w <= zero));
+    if (!inside.any())
+        return 0;
+
+    vfloat det = u + v + w;
+    t = (u*az + v*bz + w*cz) * sz / det;
+    vmask hit = inside & ((det < zero) | (det > zero)) & (t > vfloat(tmin)) & (t < vfloat(tmax));
+    return hit.bits();
+}
+
+// Lane of the closest hit of the pack with t in (tmin, tmax), or -1.
+inline int hit_triangle_pack(const triangle_pack& pack, const ray_shear& shear, float tmin, float tmax, float& t_out) {
+    vfloat t;
+    uint32_t bits = triangle_pack_hits(pack, shear, tmin, tmax, t);
+    if (!bits)
+        return -1;
+
+    float lanes[simd_width];
+    t.store(lanes);
+    int best = -1;
+    for (; bits; bits &= bits - 1) {
+        int lane = first_lane(bits);
+        if (best < 0 || lanes[lane] < lanes[best])
+            best = lane;
+    }
+    t_out = lanes[best];
+    return best;
+}
+
+// Object interface of triangle_pack, so basic_bvh can hold packs by value (see primitive.h).
+// A pack doesn't know its mesh: hits carry the triangle index only, and triangle_mesh fills in
+// ray_hit::object.
+inline bool intersect_object(const triangle_pack& pack, const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) {
+    float t;
+    int lane = hit_triangle_pack(pack, ray_shear(r), float(ray_tmin), float(ray_tmax), t);
+    if (lane < 0)
+        return false;
+    hit = ray_hit{t, nullptr, nullptr, pack.triangle[lane]};
+    return true;
+}
+
+inline void intersect_object_packet(const triangle_pack& pack, const ray_packet& packet, packet_hits& hits) {
+    for (int i = 0; i < ray_packet::size; i++) {
+        float t;
+        int lane = hit_triangle_pack(pack, ray_shear(packet.get(i)), packet.tmin, hits.t[i], t);
+        if (lane >= 0) {
+            hits.t[i] = t;
+            hits.prim[i] = pack.triangle[lane];
+        }
+    }
+}
+
+inline bool occluded_object(const triangle_pack& pack, const ray& r, real ray_tmin, real ray_tmax) {
+    vfloat t;
+    return triangle_pack_hits(pack, ray_shear(r), float(ray_tmin), float(ray_tmax), t) != 0;
+}
+
+inline void occluded_object_packet(const triangle_pack& pack, const ray_packet& packet, packet_occlusion& occlusion) {
+    for (int i = 0; i < ray_packet::size; i++) {
+        vfloat t;
+        if (!occlusion.occluded(i) && triangle_pack_hits(pack, ray_shear(packet.get(i)), packet.tmin, occlusion.t[i], t))
+            occlusion.set_occluded(i);
+    }
+}
+
+inline aabb object_bounds(const triangle_pack& pack) {
+    return pack.bbox;
+}
+
+
+// Indexed triangle mesh: one shared vertex array and three vertex indices per triangle, plus one
+// material for the whole mesh. For tracing, the triangles are sorted along a Morton curve, so that
+// nearby triangles end up together, and grouped into triangle_packs of simd_width. A BVH is then
+// built over the packs. A leaf test thus checks simd_width triangles per instruction. The pack
+// copies of the vertices cost about 40 bytes per triangle on top of the shared buffers.
+class triangle_mesh final : public hittable {
+public:
+    triangle_mesh(std::vector<vec3> vertex_positions, std::vector<uint32_t> vertex_indices,
+                  const material& mat = material::diffuse(color(0.5, 0.5, 0.5)))
+        : positions(std::move(vertex_positions)), indices(std::move(vertex_indices)), mat(mat) {
+        indices.resize(indices.size() / 3 * 3);
+        build();
+    }
+
+    // Mesh whose packs and BVH were built earlier, e.g. loaded from a scene cache.
+    triangle_mesh(std::vector<vec3> vertex_positions, std::vector<uint32_t> vertex_indices,
+                  const material& mat, basic_bvh<triangle_pack> prebuilt)
+        : positions(std::move(vertex_positions)), indices(std::move(vertex_indices)), mat(mat), tree(std::move(prebuilt)) {}
+
+    size_t triangle_count() const { return indices.size() / 3; }
+    const std::vector<vec3>& vertex_positions() const { return positions; }
+    const std::vector<uint32_t>& vertex_indices() const { return indices; }
+    const material& get_material() const { return mat; }
+    const basic_bvh<triangle_pack>& bvh() const { return tree; }
+
+    bool intersect(const ray& r, real ray_tmin, real ray_tmax, ray_hit& hit) const override {
+        if (!tree.intersect(r, ray_tmin, ray_tmax, hit))
+            return false;
+        hit.object = this;
+        return true;
+    }
+
+    void intersect_packet(const ray_packet& packet, packet_hits& hits) const override {
+        float before[ray_packet::size];
+        std::copy(std::begin(hits.t), std::end(hits.t), before);
+        tree.intersect_packet(packet, hits);
+        for (int i = 0; i < ray_packet::size; i++) {
+            if (hits.t[i] != before[i]) {
+                hits.object[i] = this;
+                hits.instance[i] = nullptr;
+            }
+        }
+    }
+
+    bool occluded(const ray& r, real ray_tmin, real ray_tmax) const override {
+        return tree.occluded(r, ray_tmin, ray_tmax);
+    }
+
+    void occluded_packet(const ray_packet& packet, packet_occlusion& occlusion) const override {
+        tree.occluded_packet(packet, occlusion);
+    }
+
+    // The normal is the geometric one, from the triangle's winding; uv are the barycentric
+    // coordinates of the hit point relative to the triangle's second and third vertices.
+    void surface(const ray& r, const ray_hit& hit, hit_record& rec) const override {
+        const vec3& v0 = positions[indices[3*hit.prim]];
+        const vec3& v1 = positions[indices[3*hit.prim + 1]];
+        const vec3& v2 = positions[indices[3*hit.prim + 2]];
+        vec3 e1 = v1 - v0, e2 = v2 - v0;
+        vec3 n = cross(e1, e2);
+        rec.p = r.at(hit.t);
+        rec.set_face_normal(r, normalize(n));
+
+        vec3 d = rec.p - v0;
+        real inv_area = 1 / dot(n, n);
+        rec.uv = vec2(dot(cross(d, e2), n) * inv_area, dot(cross(e1, d), n) * inv_area);
+        rec.mat = &mat;
+    }
+
+    aabb bounding_box() const override { return tree.bounding_box(); }
+
+private:
+    std::vector<vec3> positions;
+    std::vector<uint32_t> indices;
+    material mat;
+    basic_bvh<triangle_pack> tree;
+
+    void build() {
+        size_t count = triangle_count();
+        if (count == 0)
+            return;
+
+        aabb centroid_bounds;
+        for (size_t i = 0; i < count; i++) {
+            centroid_bounds.expand(centroid(i));
+        }
+        vec3 extent = glm::max(centroid_bounds.max - centroid_bounds.min, vec3(1e-20f, 1e-20f, 1e-20f));
+
+        std::vector<std::pair<uint32_t, uint32_t>> order(count);   // Morton code, triangle
+        for (size_t i = 0; i < count; i++) {
+            vec3 p = (centroid(i) - centroid_bounds.min) / extent;
+            order[i] = {morton_code(p), uint32_t(i)};
+        }
+        std::sort(order.begin(), order.end());
+
+        std::vector<triangle_pack> packs((count + simd_width - 1) / simd_width);
+        for (size_t k = 0; k < packs.size(); k++) {
+            triangle_pack& pack = packs[k];
+            for (int lane = 0; lane < simd_width; lane++) {
+                size_t i = k * simd_width + size_t(lane);
+                if (i >= count) {
+                    for (int axis = 0; axis < 3; axis++) {
+                        pack.v0[axis][lane] = pack.v1[axis][lane] = pack.v2[axis][lane] = NAN;
+                    }
+                    pack.triangle[lane] = UINT32_MAX;
+                    continue;
+                }
+                uint32_t tri = order[i].second;
+                const vec3& a = positions[indices[3*tri]];
+                const vec3& b = positions[indices[3*tri + 1]];
+                const vec3& c = positions[indices[3*tri + 2]];
+                for (int axis = 0; axis < 3; axis++) {
+                    pack.v0[axis][lane] = float(a[axis]);
+                    pack.v1[axis][lane] = float(b[axis]);
+                    pack.v2[axis][lane] = float(c[axis]);
+                }
+                pack.triangle[lane] = tri;
+                pack.bbox.expand(a);
+                pack.bbox.expand(b);
+                pack.bbox.expand(c);
+            }
+        }
+        tree = basic_bvh<triangle_pack>(std::move(packs));
+    }
+
+    vec3 centroid(size_t tri) const {
+        return (positions[indices[3*tri]] + positions[indices[3*tri + 1]] + positions[indices[3*tri + 2]]) / real(3);
+    }
+
+    // Interleaves the bits of three coordinates in [0, 1], 10 bits each.
+    static uint32_t morton_code(const vec3& p) {
+        auto spread = [](real x) {
+            uint32_t v = uint32_t(std::clamp(x * real(1024), real(0), real(1023)));
+            v = (v * 0x00010001U) & 0xFF0000FFU;
+            v = (v * 0x00000101U) & 0x0F00F00FU;
+            v = (v * 0x00000011U) & 0xC30C30C3U;
+            v = (v * 0x00000005U) & 0x49249249U;
+            return v;
+        };
+        return (spread(p.x) << 2) | (spread(p.y) << 1) | spread(p.z);
+    }
+};
+
+#endif //TRIANGLE_MESH_H
@@ -0,0 +1,51 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+#include <cstdint>
+
+
+// Lock-free hand-over of values from one producer thread to one consumer thread. The producer
+// fills back() and publish()es it; the consumer acquire()s the newest published value as front().
+// Neither side ever waits for the other: a value published before the consumer got to the
+// previous one simply replaces it.
+template<typename T>
+class triple_buffer {
+public:
+    // Producer side: the buffer being filled.
+    T& back() { return buffers[back_index]; }
+
+    // Producer side: makes back() the newest value and continues with a free buffer.
+    void publish() {
+        uint32_t previous = middle.exchange(back_index | fresh_bit, std::memory_order_acq_rel);
+        back_index = previous & index_mask;
+    }
+
+    // Consumer side: moves to the newest published value. Returns false, keeping front() as it
+    // is, if nothing was published since the last call.
+    bool acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & fresh_bit))
+            return false;
+        uint32_t previous = middle.exchange(front_index, std::memory_order_acq_rel);
+        front_index = previous & index_mask;
+        return true;
+    }
+
+    // Buffer i of the three, for setting them up before either side starts using them.
+    T& buffer(int i) { return buffers[i]; }
+
+    // Consumer side: the value last acquired.
+    T& front() { return buffers[front_index]; }
+    const T& front() const { return buffers[front_index]; }
+
+private:
+    static constexpr uint32_t index_mask = 3;
+    static constexpr uint32_t fresh_bit = 4;
+
+    T buffers[3];
+    uint32_t back_index = 0;                  // Owned by the producer
+    std::atomic<uint32_t> middle{1};          // Index of the spare buffer, plus fresh_bit if unread
+    uint32_t front_index = 2;                 // Owned by the consumer
+};
+
+#endif //TRIPLE_BUFFER_H
@@ -0,0 +1,194 @@
+#ifndef TEXTURE_STREAM_H
+#define TEXTURE_STREAM_H
+
+#include <glad/glad.h>
+
+#include "raytracer/raytracer.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+// GL 4.x names that a GL 3.3 loader may not provide.
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+
+// Streams traced frames into a texture for display.
+//
+// The texture has a single level (no mipmaps; the frame is drawn about 1:1) and its storage,
+// immutable where the driver has texture storage (GL 4.2), only grows: a smaller frame goes into
+// the lower left corner, and frame_texcoords() tells the shader which part to show. Frames
+// reach it through pixel buffer objects:
+// - With buffer storage (GL 4.4, ARB_buffer_storage; Mesa's llvmpipe has it) there is one
+//   persistently mapped PBO per async_renderer frame slot. The render threads trace straight into
+//   mapped memory, and an upload is a GPU-side copy with no CPU copy at all.
+// - Otherwise a single PBO is orphaned and mapped every frame, and the frame is copied into it.
+//   That still avoids reallocating the texture and lets the driver pipeline the transfer.
+class texture_stream {
+public:
+    using loader = void* (*)(const char* name);
+
+    // Needs a current GL context. max_width/max_height bound the frames that can be traced
+    // straight into mapped memory; larger frames take the copying path.
+    texture_stream(loader get_proc, int max_width, int max_height) : slot_size(size_t(max_width) * max_height * 3) {
+        GLint major = 0, minor = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+        int version = major * 10 + minor;
+        if (version >= 42 || has_extension("GL_ARB_texture_storage"))
+            tex_storage_2d = reinterpret_cast<tex_storage_2d_fn>(get_proc("glTexStorage2D"));
+        if (version >= 44 || has_extension("GL_ARB_buffer_storage"))
+            buffer_storage = reinterpret_cast<buffer_storage_fn>(get_proc("glBufferStorage"));
+
+        glGenTextures(1, &texture_id);
+        glGenBuffers(1, &stream_pbo);
+        if (buffer_storage != nullptr) {
+            glGenBuffers(3, pbos);
+            for (int i = 0; i < 3; i++) {
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+                GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                buffer_storage(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(slot_size), nullptr, flags);
+                slots[i] = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(slot_size), flags));
+            }
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            if (slots[0] == nullptr || slots[1] == nullptr || slots[2] == nullptr)
+                slots = {};
+        }
+    }
+
+    ~texture_stream() {
+        for (int i = 0; i < 3; i++) {
+            if (fences[i] != nullptr)
+                glDeleteSync(fences[i]);
+        }
+        if (buffer_storage != nullptr)
+            glDeleteBuffers(3, pbos);
+        glDeleteBuffers(1, &stream_pbo);
+        glDeleteTextures(1, &texture_id);
+    }
+
+    texture_stream(const texture_stream&) = delete;
+    texture_stream& operator=(const texture_stream&) = delete;
+
+    // Mapped memory the render threads can trace into (see async_renderer), or null pointers when
+    // persistent mapping isn't available.
+    const std::array<unsigned char*, 3>& targets() const { return slots; }
+    size_t target_size() const { return slot_size; }
+
+    bool persistent() const { return slots[0] != nullptr; }
+    bool immutable() const { return tex_storage_2d != nullptr; }
+
+    unsigned int texture() const { return texture_id; }
+
+    // Blocks until the GPU has read the frame out of its mapped slot, so the renderer may reuse
+    // it. Call before acquiring the next frame; the copy was issued a display frame ago and has
+    // normally long finished.
+    void release(const async_renderer::frame& frame) {
+        if (!frame.in_target || fences[frame.slot] == nullptr)
+            return;
+        while (glClientWaitSync(fences[frame.slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000) == GL_TIMEOUT_EXPIRED) {}
+        glDeleteSync(fences[frame.slot]);
+        fences[frame.slot] = nullptr;
+    }
+
+    // Copies a frame into the texture, which is bound to GL_TEXTURE_2D afterwards.
+    void upload(const async_renderer::frame& frame) {
+        glBindTexture(GL_TEXTURE_2D, texture_id);
+        if (frame.width > width || frame.height > height)
+            allocate(std::max(frame.width, width), std::max(frame.height, height));
+        shown_width = frame.width;
+        shown_height = frame.height;
+
+        size_t size = size_t(frame.width) * frame.height * 3;
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (frame.in_target) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[frame.slot]);
+        } else {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, stream_pbo);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(size), nullptr, GL_STREAM_DRAW);   // Orphan
+            void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(size),
+                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (mapped != nullptr) {
+                std::memcpy(mapped, frame.pixels, size);
+                glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            }
+        }
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, frame.width, frame.height, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        if (frame.in_target) {
+            if (fences[frame.slot] != nullptr)
+                glDeleteSync(fences[frame.slot]);
+            fences[frame.slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+    }
+
+    // Maps the quad's [0, 1]^2 texture coordinates onto the texel centers of the last uploaded
+    // frame: texcoord * scale + offset.
+    void frame_texcoords(float& offset_u, float& offset_v, float& scale_u, float& scale_v) const {
+        if (width == 0) {
+            offset_u = offset_v = scale_u = scale_v = 0.0f;
+            return;
+        }
+        offset_u = 0.5f / width;
+        offset_v = 0.5f / height;
+        scale_u = float(shown_width - 1) / width;
+        scale_v = float(shown_height - 1) / height;
+    }
+
+private:
+    typedef void (APIENTRY* tex_storage_2d_fn)(GLenum, GLsizei, GLenum, GLsizei, GLsizei);
+    typedef void (APIENTRY* buffer_storage_fn)(GLenum, GLsizeiptr, const void*, GLbitfield);
+
+    tex_storage_2d_fn tex_storage_2d = nullptr;
+    buffer_storage_fn buffer_storage = nullptr;
+
+    unsigned int texture_id = 0;
+    int width = 0, height = 0;                  // Size of the texture storage
+    int shown_width = 0, shown_height = 0;      // Size of the last uploaded frame
+    unsigned int pbos[3] = {};                  // Persistently mapped, one per frame slot
+    std::array<unsigned char*, 3> slots = {};
+    size_t slot_size;
+    GLsync fences[3] = {};                      // Pending GPU reads of each slot
+    unsigned int stream_pbo = 0;                // Orphaned and refilled on the copying path
+
+    // (Re)creates the texture storage. Immutable storage can't be resized, so a new size needs a
+    // new texture object. The old contents are dropped; the caller uploads a frame right after.
+    void allocate(int w, int h) {
+        if (width != 0 && tex_storage_2d != nullptr) {
+            glDeleteTextures(1, &texture_id);
+            glGenTextures(1, &texture_id);
+            glBindTexture(GL_TEXTURE_2D, texture_id);
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        if (tex_storage_2d != nullptr) {
+            tex_storage_2d(GL_TEXTURE_2D, 1, GL_RGB8, w, h);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+        }
+        width = w;
+        height = h;
+    }
+
+    static bool has_extension(const char* name) {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const char* ext = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+            if (ext != nullptr && std::strcmp(ext, name) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+#endif //TEXTURE_STREAM_H
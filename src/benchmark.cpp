@@ -0,0 +1,290 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "raytracer/raytracer.h"
+
+// Microbenchmarks for the raytracer core. Scenes and rays come from fixed seeds, so numbers are
+// comparable between runs and between hosts. Every case is run once to warm up and then
+// `repetitions` times; the median run is reported.
+//
+// Usage: RendererBench [--format csv|json] [--quick] [--filter SUBSTRING]
+//   --format    output format, one result per row/object (default csv)
+//   --quick     fewer repetitions and smaller frames, for smoke testing
+//   --filter    only run cases whose name contains SUBSTRING
+//
+// Reported per case: rays traced per run, median ns/ray, Mrays/s, and for multithreaded
+// render cases the scaling efficiency relative to the 1-thread run at the same resolution.
+
+struct bench_settings {
+    std::string format = "csv";
+    bool quick = false;
+    std::string filter;
+};
+
+struct bench_result {
+    std::string name;
+    int threads = 1;
+    long long rays = 0;
+    double seconds = 0.0;          // Median wall time of one run
+    double efficiency = -1.0;      // Throughput / (threads * 1-thread throughput), -1 if n/a
+
+    double ns_per_ray() const { return seconds * 1e9 / double(rays); }
+    double mrays_per_second() const { return double(rays) / seconds / 1e6; }
+};
+
+volatile double sink;  // Keeps the optimizer from discarding benchmarked work
+
+
+// Runs `run` once to warm up, then `repetitions` times, and returns the median time in seconds.
+double time_median(int repetitions, const std::function<void()>& run) {
+    run();
+    std::vector<double> times;
+    for (int i = 0; i < repetitions; i++) {
+        auto t0 = std::chrono::steady_clock::now();
+        run();
+        auto t1 = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double>(t1 - t0).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+// Uniformly scattered spheres in a box in front of the camera; the same for a given seed.
+primitive_list random_spheres(int count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    float extent = 2.0f * std::cbrt(float(count));
+    std::uniform_real_distribution<float> pos(-extent, extent);
+    std::uniform_real_distribution<float> rad(0.1f, 0.5f);
+    primitive_list world;
+    for (int i = 0; i < count; i++) {
+        world.add(sphere(vec3(pos(rng), pos(rng), pos(rng) - 2.0f * extent), rad(rng)));
+    }
+    return world;
+}
+
+std::vector<ray> random_rays(int count, uint32_t seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> dir(-1.0f, 1.0f);
+    std::vector<ray> rays;
+    rays.reserve(count);
+    for (int i = 0; i < count; i++) {
+        rays.emplace_back(vec3(0, 0, 0), vec3(dir(rng), dir(rng), -1.0f));
+    }
+    return rays;
+}
+
+bench_result bench_hits(const std::string& name, const hittable& world, const std::vector<ray>& rays, int repetitions) {
+    bench_result result;
+    result.name = name;
+    result.rays = (long long)rays.size();
+    result.seconds = time_median(repetitions, [&](){
+        double t_sum = 0.0;
+        hit_record rec;
+        for (const auto& r : rays) {
+            if (world.hit(r, 0.001, INFINITY, rec))
+                t_sum += rec.t;
+        }
+        sink = t_sum;
+    });
+    return result;
+}
+
+// Any-hit queries over the same rays, as shadow and visibility rays make them.
+bench_result bench_occlusion(const std::string& name, const hittable& world, const std::vector<ray>& rays, int repetitions) {
+    bench_result result;
+    result.name = name;
+    result.rays = (long long)rays.size();
+    result.seconds = time_median(repetitions, [&](){
+        int blocked = 0;
+        for (const auto& r : rays) {
+            blocked += world.occluded(r, 0.001, INFINITY);
+        }
+        sink = blocked;
+    });
+    return result;
+}
+
+std::vector<int> thread_counts() {
+    std::vector<int> counts;
+    for (int n = 1; n < default_thread_count(); n *= 2) {
+        counts.push_back(n);
+    }
+    counts.push_back(default_thread_count());
+    return counts;
+}
+
+
+void print_results(const std::vector<bench_result>& results, const std::string& format) {
+    if (format == "json") {
+        std::cout << "[\n";
+        for (size_t i = 0; i < results.size(); i++) {
+            const auto& r = results[i];
+            std::cout << "  {\"name\": \"" << r.name << "\", \"threads\": " << r.threads
+                      << ", \"rays\": " << r.rays << ", \"seconds\": " << r.seconds
+                      << ", \"ns_per_ray\": " << r.ns_per_ray() << ", \"mrays_per_s\": " << r.mrays_per_second();
+            if (r.efficiency >= 0.0)
+                std::cout << ", \"scaling_efficiency\": " << r.efficiency;
+            std::cout << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+        }
+        std::cout << "]" << std::endl;
+    } else {
+        std::cout << "name,threads,rays,seconds,ns_per_ray,mrays_per_s,scaling_efficiency\n";
+        for (const auto& r : results) {
+            std::cout << r.name << ',' << r.threads << ',' << r.rays << ',' << r.seconds << ','
+                      << r.ns_per_ray() << ',' << r.mrays_per_second() << ',';
+            if (r.efficiency >= 0.0)
+                std::cout << r.efficiency;
+            std::cout << '\n';
+        }
+        std::cout << std::flush;
+    }
+}
+
+
+int main(int argc, char** argv) {
+    bench_settings settings;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--format" && i + 1 < argc) {
+            settings.format = argv[++i];
+        } else if (arg == "--quick") {
+            settings.quick = true;
+        } else if (arg == "--filter" && i + 1 < argc) {
+            settings.filter = argv[++i];
+        } else {
+            std::cerr << "Unknown argument: " << arg << std::endl;
+            return 1;
+        }
+    }
+
+    int repetitions = settings.quick ? 3 : 7;
+    auto enabled = [&](const std::string& name) {
+        return settings.filter.empty() || name.find(settings.filter) != std::string::npos;
+    };
+    std::vector<bench_result> results;
+
+    // Single primitive.
+    if (enabled("sphere_hit")) {
+        sphere s(vec3(0, 0, -3), 1.0f);
+        results.push_back(bench_hits("sphere_hit", s, random_rays(1 << 20, 1), repetitions));
+    }
+
+    // Linear lists vs. acceleration structures at growing scene sizes. The ray count shrinks
+    // with the list size so the O(N) cases stay within a few seconds.
+    for (int count : {10, 1000, 100000}) {
+        std::string suffix = "_" + std::to_string(count);
+        primitive_list prims = random_spheres(count, 2);
+        int num_rays = std::max(1 << 10, (1 << 22) / count);
+        std::vector<ray> rays = random_rays(num_rays, 3);
+
+        if (enabled("hittable_list_hit" + suffix)) {
+            hittable_list list;
+            for (const auto& p : prims.objects) {
+                list.add(make_shared<sphere>(std::get<sphere>(p)));
+            }
+            results.push_back(bench_hits("hittable_list_hit" + suffix, list, rays, repetitions));
+        }
+        if (enabled("sphere_set_hit" + suffix)) {
+            sphere_set set;
+            for (const auto& p : prims.objects) {
+                const sphere& s = std::get<sphere>(p);
+                set.add(s.get_center(), float(s.get_radius()), s.get_material());
+            }
+            results.push_back(bench_hits("sphere_set_hit" + suffix, set, rays, repetitions));
+        }
+        if (enabled("bvh_hit" + suffix)) {
+            static_bvh tree(prims);
+            results.push_back(bench_hits("bvh_hit" + suffix, tree, random_rays(1 << 18, 3), repetitions));
+        }
+        if (enabled("bvh_occluded" + suffix)) {
+            static_bvh tree(prims);
+            results.push_back(bench_occlusion("bvh_occluded" + suffix, tree, random_rays(1 << 18, 3), repetitions));
+        }
+    }
+
+    // Primary ray generation alone.
+    if (enabled("ray_generation")) {
+        camera cam;
+        cam.width = 1920;
+        cam.image_height = 1080;
+        cam.update();
+        bench_result result;
+        result.name = "ray_generation";
+        result.rays = 1920LL * 1080;
+        result.seconds = time_median(repetitions, [&](){
+            float sum = 0.0f;
+            for (int j = 0; j < 1080; j++) {
+                for (int i = 0; i < 1920; i++) {
+                    sum += cam.get_ray(i, j).direction().x;
+                }
+            }
+            sink = sum;
+        });
+        results.push_back(result);
+    }
+
+    // Full frames of a 1k sphere BVH scene at several resolutions and thread counts.
+    primitive_list frame_world = random_spheres(1000, 4);
+    static_bvh frame_scene(frame_world);
+    std::vector<std::pair<int, int>> resolutions = {{320, 180}, {1280, 720}, {1920, 1080}};
+    if (settings.quick)
+        resolutions.resize(2);
+    for (auto [w, h] : resolutions) {
+        std::string name = "render_" + std::to_string(w) + "x" + std::to_string(h);
+        if (!enabled(name))
+            continue;
+
+        std::vector<unsigned char> pixels(size_t(w) * h * 3);
+        double single_thread_rate = 0.0;
+        for (int threads : thread_counts()) {
+            camera cam;
+            cam.width = w;
+            cam.image_height = h;
+            cam.aspect_ratio = float(w) / h;
+            cam.yaw = 90.0f;
+            cam.num_threads = threads;
+
+            bench_result result;
+            result.name = name;
+            result.threads = threads;
+            result.rays = (long long)w * h;
+            result.seconds = time_median(repetitions, [&](){ cam.render(pixels.data(), frame_scene); });
+            if (threads == 1)
+                single_thread_rate = result.mrays_per_second();
+            if (single_thread_rate > 0.0)
+                result.efficiency = result.mrays_per_second() / (threads * single_thread_rate);
+            results.push_back(result);
+        }
+    }
+
+    // The same scene as a flat primitive_list, binned to screen tiles for primary rays instead
+    // of traversing a BVH.
+    for (auto [w, h] : resolutions) {
+        std::string name = "render_binned_" + std::to_string(w) + "x" + std::to_string(h);
+        if (!enabled(name))
+            continue;
+
+        std::vector<unsigned char> pixels(size_t(w) * h * 3);
+        camera cam;
+        cam.width = w;
+        cam.image_height = h;
+        cam.aspect_ratio = float(w) / h;
+        cam.yaw = 90.0f;
+
+        bench_result result;
+        result.name = name;
+        result.threads = cam.num_threads;
+        result.rays = (long long)w * h;
+        result.seconds = time_median(repetitions, [&](){ cam.render(pixels.data(), frame_world); });
+        results.push_back(result);
+    }
+
+    print_results(results, settings.format);
+    return 0;
+}
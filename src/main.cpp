@@ -2,21 +2,68 @@
 #include <GLFW/glfw3.h>
 #include <glad/glad.c>
 #include <iostream>
+#include <memory>
+#include <charconv>
 #include <chrono>
+#include <cstring>
+#include <string>
+#include <tuple>
 
 #include "shader.h"
+#include "texture_stream.h"
 #include "raytracer/raytracer.h"
 
+// Directory holding vt.glsl/ft.glsl, set by CMake to the source tree.
+#ifndef SHADER_DIR
+#define SHADER_DIR "src"
+#endif
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
+void key_callback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/);
 void processInput(GLFWwindow *window, camera *cam, double* mouse_pos, long long dt);
 
-// settings
+// settings (initial window size; the render resolution follows the window, see resolution_controller)
 const unsigned int SCR_WIDTH = 200;
 const float ASPECT_RATIO = 16.0 / 9.0;
 const unsigned int SCR_HEIGHT = SCR_WIDTH / ASPECT_RATIO;
 
 
-void run_window() {
+// Runtime render settings, see parse_args()
+struct render_settings {
+    int num_threads = default_thread_count();
+    bool pin_threads = false;
+    bool progressive = true;
+    bool reprojection = true;
+    double target_ms = 16.7;    // Trace time the render resolution is scaled for, 0 for a fixed scale
+    float min_scale = 0.25f;
+    float max_scale = 1.0f;
+    int max_depth = 8;          // Path tracing bounces, 0 to shade by surface normal
+    std::string scene;          // Scene file or compiled scene cache, empty for the built-in scene
+};
+
+
+void run_window(const render_settings& settings) {
+    // Load the scene before opening the window; a compiled cache is ready to trace right away.
+    scene world_scene;
+    if (!settings.scene.empty()) {
+        std::string error;
+        bool loaded = is_scene_cache(settings.scene) ? load_scene_cache(settings.scene, world_scene, error)
+                                                     : load_scene(settings.scene, world_scene, error, settings.num_threads);
+        if (!loaded) {
+            std::cout << error << std::endl;
+            return;
+        }
+    } else {
+        // 2 spheres on a ground sphere, lit by an emissive sphere
+        primitive_list world;
+        world.add(sphere(vec3(-0.5,0,-1), 0.3, material::diffuse(color(0.7, 0.3, 0.3))));
+        world.add(sphere(vec3(0.5,0,-1), 0.3, material::metal(color(0.8, 0.8, 0.8), 0.1)));
+        world.add(sphere(vec3( 0.0, -100.3, -1.0), 100.0, material::diffuse(color(0.5, 0.5, 0.5))));
+        world.add(sphere(vec3(0, 1.5, -1), 0.5, material::emissive(color(4, 4, 4))));
+        world_scene.primitives = make_shared<static_bvh>(world);
+        world_scene.update_world();
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
@@ -35,7 +82,9 @@ void run_window() {
         glfwTerminate();
     }
     glfwMakeContextCurrent(window);
+    glfwSwapInterval(1);    // Present at display rate; tracing runs on its own thread
     glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    glfwSetKeyCallback(window, key_callback);
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
@@ -43,8 +92,7 @@ void run_window() {
     }
 
     // Use Shader class to compile shaders
-    Shader ourShader("/Users/vinithyedidi/CodingProjects/CLion/Renderer/src/vt.glsl",
-        "/Users/vinithyedidi/CodingProjects/CLion/Renderer/src/ft.glsl");
+    Shader ourShader(SHADER_DIR "/vt.glsl", SHADER_DIR "/ft.glsl");
 
     // Generate rectangle across entire screen — this is the canvas for displaying the pixels
     float vertices[] = {
@@ -76,63 +124,121 @@ void run_window() {
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
     glEnableVertexAttribArray(2);
 
-    // Initialize pixel array to be rendered onto
-    unsigned char pixels[SCR_WIDTH*SCR_HEIGHT*3];
-    unsigned int texture;
+    // Texture the frames are streamed into. With persistent mapping the render threads trace
+    // straight into its pixel buffers, which are sized for the screen; larger frames are copied.
     glActiveTexture(GL_TEXTURE0);
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture); // all upcoming GL_TEXTURE_2D operations now have effect on this texture object
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);	// set texture wrapping to GL_REPEAT (default wrapping method)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+    int max_width = mode ? mode->width : 1920, max_height = mode ? mode->height : 1080;
+    auto stream = std::make_unique<texture_stream>((texture_stream::loader)glfwGetProcAddress, max_width, max_height);
+
+    // Render resolution, relative to the window, adjusted to hold the trace time at the target.
+    resolution_controller resolution;
+    resolution.target_ms = settings.target_ms;
+    resolution.min_scale = settings.target_ms > 0.0 ? std::min(settings.min_scale, settings.max_scale) : settings.max_scale;
+    resolution.max_scale = settings.max_scale;
 
     // set up camera
     camera cam;
     cam.aspect_ratio = 16.0 / 9.0;
     cam.width  = SCR_WIDTH;
+    cam.image_height = SCR_HEIGHT;
     cam.vfov     = 90;
     cam.lookfrom = vec3(0,0,0);
     cam.lookat   = vec3(0,0,-1);
     cam.vup      = vec3(0,1,0);
+    if (!settings.scene.empty()) {
+        cam.lookfrom = world_scene.view.lookfrom;
+        cam.yaw      = world_scene.view.yaw;
+        cam.pitch    = world_scene.view.pitch;
+        cam.vfov     = world_scene.view.vfov;
+    }
+    cam.num_threads = settings.num_threads;
+    cam.pin_threads = settings.pin_threads;
+    cam.progressive = settings.progressive;   // Refine the image while the camera stands still
+    cam.temporal_reprojection = settings.reprojection;  // Reuse last frame's pixels while it moves
+    cam.path_tracing = settings.max_depth > 0;
+    cam.max_depth = settings.max_depth;
     glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    // set up world with 2 spheres
-    hittable_list world;
-    world.add(make_shared<sphere>(vec3(-0.5,0,-1), 0.3));
-    world.add(make_shared<sphere>(vec3(0.5,0,-1), 0.3));
-    //world.add(make_shared<sphere>(vec3( 0.0, -100.5, -1.0),100.0));
+    // Frames are traced on a background thread; the loop below shows the newest finished one.
+    auto renderer = std::make_unique<async_renderer>(world_scene.world(), cam, stream->targets(), stream->target_size());
 
     // set up cursor for mouse input
     double mouse_pos[] = {0, 0};
     std::chrono::time_point<std::chrono::steady_clock> t0, t1;
     long long dt = -1;
 
+    // Frame instrumentation: P logs percentiles, T starts/stops a capture (see key_callback).
+    frame_profiler profiler;
+    glfwSetWindowUserPointer(window, &profiler);
+
     // Game loop
     while (!glfwWindowShouldClose(window)) {
 
-        t0 = std::chrono::high_resolution_clock::now();
-        processInput(window, &cam, mouse_pos, dt);
-        glClear(GL_COLOR_BUFFER_BIT);
-
-        // Use rendering engine to generate array of pixels to display on screen
-        cam.render(pixels, world);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, SCR_WIDTH, SCR_HEIGHT,
-            0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        ourShader.use();
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-
-        t1 = std::chrono::high_resolution_clock::now();
+        t0 = std::chrono::steady_clock::now();
+        profiler.begin_frame();
+        int window_width, window_height;
+        bool moving;
+        {
+            auto phase = profiler.phase("input");
+            glfwPollEvents();
+            auto pose = std::tuple(cam.lookfrom, cam.yaw, cam.pitch);
+            processInput(window, &cam, mouse_pos, dt);
+            moving = pose != std::tuple(cam.lookfrom, cam.yaw, cam.pitch);
+
+            glfwGetFramebufferSize(window, &window_width, &window_height);
+            resolution.render_size(window_width, window_height, cam.width, cam.image_height);
+            cam.aspect_ratio = float(cam.width) / cam.image_height;
+            cam.update();   // Refresh the camera basis that processInput moves along
+            renderer->set_view(cam);
+        }
+
+        // Upload the newest traced frame, if one finished since the last display frame. Its trace
+        // ran on the render thread and is recorded with the display frame that shows it.
+        {
+            auto phase = profiler.phase("upload");
+            stream->release(renderer->latest());
+            if (renderer->acquire()) {
+                const async_renderer::frame& frame = renderer->latest();
+                profiler.add_phase("trace", frame.trace_start, frame.trace_end);
+                profiler.add_threads(frame.threads);
+                stream->upload(frame);
+
+                // Only rescale while the view moves; a still view keeps its resolution so that
+                // progressive accumulation can converge.
+                if (moving || !cam.progressive) {
+                    double trace_ms = std::chrono::duration<double, std::milli>(frame.trace_end - frame.trace_start).count();
+                    resolution.update(trace_ms, frame.traced, window_width, window_height);
+                }
+            }
+        }
+        {
+            auto phase = profiler.phase("draw");
+            glClear(GL_COLOR_BUFFER_BIT);
+            glBindTexture(GL_TEXTURE_2D, stream->texture());
+            ourShader.use();
+            float offset_u, offset_v, scale_u, scale_v;
+            stream->frame_texcoords(offset_u, offset_v, scale_u, scale_v);
+            ourShader.setVec4("texRect", offset_u, offset_v, scale_u, scale_v);
+            glBindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        }
+        {
+            auto phase = profiler.phase("swap");
+            glfwSwapBuffers(window);
+        }
+        profiler.end_frame();
+
+        t1 = std::chrono::steady_clock::now();
         dt = std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
-        std::cout << '\r' << 1000000.0f/dt << " fps" << std::flush;
+        std::cout << '\r' << 1000000.0f/dt << " fps, rendering " << cam.width << 'x' << cam.image_height
+                  << "    " << std::flush;
     }
 
-    // De-allocate all resources once they've outlived their purpose:
+    // De-allocate all resources once they've outlived their purpose. The render thread may be
+    // tracing into the stream's mapped buffers, so it stops first.
+    renderer.reset();
+    stream.reset();
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &EBO);
@@ -140,8 +246,70 @@ void run_window() {
 }
 
 
-int main() {
-    run_window();
+// Parses the whole of text as a number; false for anything else, or a value out of T's range.
+template <typename T>
+bool parse_number(const char* text, T& value) {
+    const char* end = text + std::strlen(text);
+    auto [last, status] = std::from_chars(text, end, value);
+    return status == std::errc() && last == end;
+}
+
+
+// Usage: Renderer [--threads N] [--pin] [--no-progressive] [--no-reprojection]
+//                 [--target-ms MS] [--min-scale S] [--max-scale S] [--depth N] [--scene PATH]
+//   --threads N         number of render threads (default: hardware concurrency)
+//   --pin               pin render threads to CPUs, one per physical core before SMT siblings
+//   --no-progressive    trace every frame from scratch instead of accumulating a still view
+//   --no-reprojection   retrace every pixel of a moving view instead of reusing the last frame
+//   --target-ms MS      trace time the render resolution is adjusted for (default 16.7, 0: fixed)
+//   --min-scale S       lowest render resolution, as a fraction of the window's (default 0.25)
+//   --max-scale S       highest render resolution, and the fixed one with --target-ms 0 (default 1)
+//   --depth N           path tracing bounces (default 8, 0: shade by surface normal instead)
+//   --scene PATH        scene file or compiled scene cache (see RenderCLI --write-cache) to show
+// Returns false, after saying why, if a value isn't a number in range.
+bool parse_args(int argc, char** argv, render_settings& settings) {
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        bool valid = true;
+        if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            valid = parse_number(argv[++i], settings.num_threads);
+            settings.num_threads = std::max(1, settings.num_threads);
+        } else if (std::strcmp(argv[i], "--pin") == 0) {
+            settings.pin_threads = true;
+        } else if (std::strcmp(argv[i], "--no-progressive") == 0) {
+            settings.progressive = false;
+        } else if (std::strcmp(argv[i], "--no-reprojection") == 0) {
+            settings.reprojection = false;
+        } else if (std::strcmp(argv[i], "--target-ms") == 0 && i + 1 < argc) {
+            valid = parse_number(argv[++i], settings.target_ms);
+        } else if (std::strcmp(argv[i], "--min-scale") == 0 && i + 1 < argc) {
+            valid = parse_number(argv[++i], settings.min_scale);
+            settings.min_scale = std::clamp(settings.min_scale, 0.01f, 4.0f);
+        } else if (std::strcmp(argv[i], "--max-scale") == 0 && i + 1 < argc) {
+            valid = parse_number(argv[++i], settings.max_scale);
+            settings.max_scale = std::clamp(settings.max_scale, 0.01f, 4.0f);
+        } else if (std::strcmp(argv[i], "--depth") == 0 && i + 1 < argc) {
+            valid = parse_number(argv[++i], settings.max_depth);
+            settings.max_depth = std::max(0, settings.max_depth);
+        } else if (std::strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            settings.scene = argv[++i];
+        } else {
+            std::cout << "Unknown argument: " << argv[i] << std::endl;
+        }
+        if (!valid) {
+            std::cerr << "Invalid number for " << option << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+
+int main(int argc, char** argv) {
+    render_settings settings;
+    if (!parse_args(argc, argv, settings))
+        return 1;
+    run_window(settings);
     return 0;
 }
 
@@ -186,7 +354,7 @@ void processInput(GLFWwindow *window, camera *cam, double* mouse_pos, long long
     if (glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS) {
         move_vector -= cam->up;
     }
-    move_vector   *= cam->movement_speed;
+    move_vector   *= real(cam->movement_speed);
     cam->lookfrom += move_vector;
     cam->lookat   += move_vector;
 
@@ -207,6 +375,29 @@ void processInput(GLFWwindow *window, camera *cam, double* mouse_pos, long long
     mouse_pos[1] = new_y;
 }
 
+// One-shot keys: P logs frame time percentiles, T starts a capture and, when pressed again,
+// writes it to frame_times.csv and frame_trace.json (Chrome trace) in the working directory.
+void key_callback(GLFWwindow* window, int key, int /*scancode*/, int action, int /*mods*/) {
+    auto* profiler = static_cast<frame_profiler*>(glfwGetWindowUserPointer(window));
+    if (action != GLFW_PRESS || profiler == nullptr)
+        return;
+
+    if (key == GLFW_KEY_P) {
+        std::cout << '\n' << profiler->summary() << std::flush;
+    }
+    if (key == GLFW_KEY_T) {
+        if (!profiler->is_capturing()) {
+            profiler->start_capture();
+            std::cout << "\nFrame capture started" << std::endl;
+        } else {
+            profiler->stop_capture();
+            bool ok = profiler->write_csv("frame_times.csv") && profiler->write_chrome_trace("frame_trace.json");
+            std::cout << '\n' << (ok ? "Frame capture written to frame_times.csv and frame_trace.json"
+                                      : "Failed to write frame capture") << std::endl;
+        }
+    }
+}
+
 // React to change in window size.
 void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
     // make sure the viewport matches the new window dimensions
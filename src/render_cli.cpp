@@ -0,0 +1,206 @@
+#include <iostream>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "raytracer/raytracer.h"
+
+// Headless renderer: traces one frame of the scene and writes it to an image file.
+// Needs no window, GL context or GPU, so it runs on display-less render hosts.
+//
+// Usage: RenderCLI [options]
+//   --width W          image width in pixels (default 800)
+//   --height H         image height in pixels (default width * 9/16)
+//   --samples N        samples per pixel (default 1)
+//   --threads N        render threads (default: hardware concurrency)
+//   --pin              pin render threads to CPUs
+//   --fov DEGREES      vertical field of view (default 90)
+//   --pos X Y Z        camera position (default 0 0 0)
+//   --yaw DEGREES      camera yaw (default 90: the camera looks along -forward, i.e. down -z)
+//   --pitch DEGREES    camera pitch (default 0)
+//   --depth N          path tracing bounces (default 8, 0: shade by surface normal instead)
+//   --random           sample bounces with plain random numbers instead of the Sobol sequence
+//   --scene PATH       scene file or compiled scene cache to render instead of the built-in
+//                      scene; its camera replaces --pos, --yaw, --pitch and --fov
+//   --mesh PATH        add a triangle mesh (.obj or binary .ply) to the scene
+//   --write-cache PATH compile the scene into a cache file for --scene, then exit
+//   --output PATH      output PPM file (default render.ppm)
+
+struct cli_settings {
+    int width = 800;
+    int height = 0;
+    int samples = 1;
+    int num_threads = default_thread_count();
+    bool pin_threads = false;
+    double vfov = 90.0;
+    vec3 lookfrom = vec3(0, 0, 0);
+    float yaw = 90.0f;
+    float pitch = 0.0f;
+    int max_depth = 8;
+    bool random_sampling = false;
+    std::string scene;
+    std::string mesh;
+    std::string cache;
+    std::string output = "render.ppm";
+};
+
+
+// Parses the whole of text as a number; false for anything else, or a value out of T's range.
+template <typename T>
+bool parse_number(const char* text, T& value) {
+    const char* end = text + std::strlen(text);
+    auto [last, status] = std::from_chars(text, end, value);
+    return status == std::errc() && last == end;
+}
+
+bool parse_args(int argc, char** argv, cli_settings& settings) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        bool valid = true;
+        if (arg == "--width" && has_value) {
+            valid = parse_number(argv[++i], settings.width);
+        } else if (arg == "--height" && has_value) {
+            valid = parse_number(argv[++i], settings.height);
+        } else if (arg == "--samples" && has_value) {
+            valid = parse_number(argv[++i], settings.samples);
+        } else if (arg == "--threads" && has_value) {
+            valid = parse_number(argv[++i], settings.num_threads);
+        } else if (arg == "--pin") {
+            settings.pin_threads = true;
+        } else if (arg == "--fov" && has_value) {
+            valid = parse_number(argv[++i], settings.vfov);
+        } else if (arg == "--pos" && i + 3 < argc) {
+            valid = parse_number(argv[i+1], settings.lookfrom.x) && parse_number(argv[i+2], settings.lookfrom.y) &&
+                    parse_number(argv[i+3], settings.lookfrom.z);
+            i += 3;
+        } else if (arg == "--yaw" && has_value) {
+            valid = parse_number(argv[++i], settings.yaw);
+        } else if (arg == "--pitch" && has_value) {
+            valid = parse_number(argv[++i], settings.pitch);
+        } else if (arg == "--depth" && has_value) {
+            valid = parse_number(argv[++i], settings.max_depth);
+        } else if (arg == "--random") {
+            settings.random_sampling = true;
+        } else if (arg == "--scene" && has_value) {
+            settings.scene = argv[++i];
+        } else if (arg == "--mesh" && has_value) {
+            settings.mesh = argv[++i];
+        } else if (arg == "--write-cache" && has_value) {
+            settings.cache = argv[++i];
+        } else if (arg == "--output" && has_value) {
+            settings.output = argv[++i];
+        } else {
+            std::cerr << "Unknown or incomplete argument: " << arg << std::endl;
+            return false;
+        }
+        if (!valid) {
+            std::cerr << "Invalid number for " << arg << std::endl;
+            return false;
+        }
+    }
+    if (settings.height <= 0)
+        settings.height = settings.width * 9 / 16;
+    if (settings.width <= 0 || settings.height <= 0 || settings.samples <= 0 || settings.num_threads <= 0 || settings.max_depth < 0) {
+        std::cerr << "Width, height, samples and threads must be positive, depth not negative" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+
+int main(int argc, char** argv) {
+    cli_settings settings;
+    if (!parse_args(argc, argv, settings))
+        return 1;
+
+    // The scene file, or the same scene as the interactive window.
+    scene world_scene;
+    std::string error;
+    if (!settings.scene.empty()) {
+        auto t0 = std::chrono::steady_clock::now();
+        bool compiled = is_scene_cache(settings.scene);
+        bool loaded = compiled ? load_scene_cache(settings.scene, world_scene, error)
+                               : load_scene(settings.scene, world_scene, error, settings.num_threads);
+        if (!loaded) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        std::cout << settings.scene << ": " << (compiled ? "scene cache" : "scene file") << " loaded in "
+                  << std::chrono::duration<double>(t1 - t0).count() * 1000.0 << " ms" << std::endl;
+        settings.lookfrom = world_scene.view.lookfrom;
+        settings.yaw = world_scene.view.yaw;
+        settings.pitch = world_scene.view.pitch;
+        settings.vfov = world_scene.view.vfov;
+    } else {
+        primitive_list spheres;
+        spheres.add(sphere(vec3(-0.5,0,-1), 0.3, material::diffuse(color(0.7, 0.3, 0.3))));
+        spheres.add(sphere(vec3(0.5,0,-1), 0.3, material::metal(color(0.8, 0.8, 0.8), 0.1)));
+        spheres.add(sphere(vec3( 0.0, -100.3, -1.0), 100.0, material::diffuse(color(0.5, 0.5, 0.5))));
+        spheres.add(sphere(vec3(0, 1.5, -1), 0.5, material::emissive(color(4, 4, 4))));
+        world_scene.primitives = make_shared<static_bvh>(spheres);
+        world_scene.view = scene_view{settings.lookfrom, settings.yaw, settings.pitch, settings.vfov};
+    }
+    if (!settings.mesh.empty()) {
+        auto t0 = std::chrono::steady_clock::now();
+        mesh_data data;
+        if (!load_mesh(settings.mesh, data, error, settings.num_threads)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        auto mesh = make_shared<triangle_mesh>(std::move(data.positions), std::move(data.indices),
+                                               material::diffuse(color(0.6, 0.6, 0.6)));
+        auto t2 = std::chrono::steady_clock::now();
+        std::cout << settings.mesh << ": " << mesh->triangle_count() << " triangles, loaded in "
+                  << std::chrono::duration<double>(t1 - t0).count() * 1000.0 << " ms, BVH built in "
+                  << std::chrono::duration<double>(t2 - t1).count() * 1000.0 << " ms" << std::endl;
+        world_scene.meshes.push_back(mesh);
+    }
+    world_scene.update_world();
+
+    if (!settings.cache.empty()) {
+        if (!write_scene_cache(settings.cache, world_scene, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        std::cout << settings.cache << ": scene cache written" << std::endl;
+        return 0;
+    }
+
+    camera cam;
+    cam.width = settings.width;
+    cam.image_height = settings.height;
+    cam.aspect_ratio = float(settings.width) / settings.height;
+    cam.samples_per_pixel = settings.samples;
+    cam.num_threads = settings.num_threads;
+    cam.pin_threads = settings.pin_threads;
+    cam.vfov = settings.vfov;
+    cam.lookfrom = settings.lookfrom;
+    cam.lookat = settings.lookfrom + vec3(0, 0, -1);
+    cam.yaw = settings.yaw;
+    cam.pitch = settings.pitch;
+    cam.path_tracing = settings.max_depth > 0;
+    cam.max_depth = settings.max_depth;
+    cam.sampling = settings.random_sampling ? sampler::sequence::random : sampler::sequence::sobol;
+
+    std::vector<unsigned char> pixels(size_t(settings.width) * settings.height * 3);
+    auto t0 = std::chrono::steady_clock::now();
+    cam.render(pixels.data(), world_scene.world());
+    auto t1 = std::chrono::steady_clock::now();
+
+    if (!write_ppm(settings.output, pixels.data(), settings.width, settings.height)) {
+        std::cerr << "Failed to write " << settings.output << std::endl;
+        return 1;
+    }
+
+    double seconds = std::chrono::duration<double>(t1 - t0).count();
+    double rays = double(settings.width) * settings.height * settings.samples;
+    std::cout << settings.output << ": " << settings.width << 'x' << settings.height << ", "
+              << settings.samples << " spp, " << seconds * 1000.0 << " ms, "
+              << rays / seconds / 1e6 << " Mrays/s" << std::endl;
+    return 0;
+}
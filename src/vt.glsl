@@ -6,9 +6,12 @@ layout (location = 2) in vec2 aTexCoord;
 out vec3 ourColor;
 out vec2 TexCoord;
 
+// Part of the texture holding the current frame: offset (xy) and scale (zw) of the texcoords
+uniform vec4 texRect;
+
 void main()
 {
 	gl_Position = vec4(aPos, 1.0);
-	TexCoord = vec2(aTexCoord.x, aTexCoord.y);
+	TexCoord = texRect.xy + aTexCoord * texRect.zw;
 	ourColor = vec3(aColor);
 }
\ No newline at end of file